@@ -0,0 +1,4 @@
+extern std_syscall
+extern deref
+extern deref8
+extern ref
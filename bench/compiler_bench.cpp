@@ -0,0 +1,283 @@
+// Times the front end and codegen on generated sources, without nasm or ld.
+//
+//     compiler_bench [--iterations=N] [--scale=N] [-j<n>] [--corpus-dir=DIR]
+//
+// Each corpus stresses one shape of source. The best of N iterations is
+// reported, since the first one also pays for interning the identifiers.
+
+#include "ASTParser.h"
+#include "Driver.h"
+#include "TimeReport.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    size_t iterations { 5 };
+    // multiplies the size of every corpus
+    size_t scale { 1 };
+    size_t jobs { 1 };
+    // modules of the import graph are written here, as `use` loads them from
+    // the file system
+    std::string corpus_dir { "bench_corpus" };
+};
+
+BenchOptions s_options;
+
+struct Corpus {
+    std::string name;
+    std::string source;
+};
+
+// every function nests `depth` ifs, each with an else
+std::string generate_deep_nesting(size_t functions, size_t depth) {
+    std::string source;
+    for (size_t i = 0; i < functions; ++i) {
+        source += "fn nested_" + std::to_string(i) + "(u64 x) -> u64 r {\n";
+        source += "    r = 0;\n";
+        for (size_t level = 0; level < depth; ++level) {
+            std::string indent((level + 1) * 4, ' ');
+            source += indent + "if (x - " + std::to_string(level) + ") {\n";
+            source += indent + "    r = r + x * " + std::to_string(level + 1) + ";\n";
+        }
+        for (size_t level = depth; level > 0; --level) {
+            std::string indent(level * 4, ' ');
+            source += indent + "} else {\n";
+            source += indent + "    r = r - " + std::to_string(level) + ";\n";
+            source += indent + "}\n";
+        }
+        source += "}\n\n";
+    }
+    source += "fn main() -> u64 r {\n    r = nested_0(3);\n}\n";
+    return source;
+}
+
+// every function declares `variables` locals and combines them, so most of
+// them live on the stack
+std::string generate_wide_functions(size_t functions, size_t variables) {
+    std::string source;
+    for (size_t i = 0; i < functions; ++i) {
+        source += "fn wide_" + std::to_string(i) + "(u64 a, u64 b, u64 c) -> u64 r {\n";
+        for (size_t v = 0; v < variables; ++v) {
+            source += "    u64 v" + std::to_string(v) + ";\n";
+            source += "    v" + std::to_string(v) + " = a * " + std::to_string(v + 1) + " + b - c + " + std::to_string(v) + ";\n";
+        }
+        source += "    r = 0";
+        for (size_t v = 0; v < variables; ++v) {
+            source += " + v" + std::to_string(v);
+        }
+        source += ";\n}\n\n";
+    }
+    source += "fn main() -> u64 r {\n    r = wide_0(1, 2, 3);\n}\n";
+    return source;
+}
+
+// every function uses `literals` distinct string literals
+std::string generate_string_literals(size_t functions, size_t literals) {
+    std::string source;
+    for (size_t i = 0; i < functions; ++i) {
+        source += "fn strings_" + std::to_string(i) + "() -> u64 r {\n";
+        source += "    u64 s;\n";
+        source += "    r = 0;\n";
+        for (size_t l = 0; l < literals; ++l) {
+            source += "    s = \"string literal " + std::to_string(i) + " " + std::to_string(l) + "\\n\";\n";
+            source += "    r = r + deref8(s);\n";
+        }
+        source += "}\n\n";
+    }
+    source += "fn main() -> u64 r {\n    r = strings_0();\n}\n";
+    return source;
+}
+
+// The root uses `width` modules, each of which uses `fanout` of `width` leaf
+// modules, so leaves are shared between their users. Returns the root.
+bool generate_import_graph(size_t width, size_t fanout, std::string& out_root) {
+    std::error_code ec;
+    auto dir = std::filesystem::path(s_options.corpus_dir) / "graph";
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "compiler_bench: failed to create \"" << dir.string() << "\": " << ec.message() << std::endl;
+        return false;
+    }
+    auto write = [&](const std::string& name, const std::string& source) {
+        std::ofstream file(dir / (name + ".xc"));
+        file << source;
+        return bool(file);
+    };
+    auto use_path = [&](const std::string& name) {
+        return (dir / name).generic_string();
+    };
+    for (size_t i = 0; i < width; ++i) {
+        std::string leaf = "leaf_" + std::to_string(i);
+        if (!write(leaf, "pure fn " + leaf + "(u64 x) -> u64 r {\n    r = x * " + std::to_string(i + 2) + " + 1;\n}\n")) {
+            std::cerr << "compiler_bench: failed to write " << leaf << std::endl;
+            return false;
+        }
+    }
+    out_root.clear();
+    for (size_t i = 0; i < width; ++i) {
+        std::string mid = "mid_" + std::to_string(i);
+        std::string source;
+        std::string body = "    r = x";
+        for (size_t f = 0; f < fanout; ++f) {
+            std::string leaf = "leaf_" + std::to_string((i + f) % width);
+            source += "use \"" + use_path(leaf) + "\";\n";
+            body += " + " + leaf + "(x)";
+        }
+        source += "\nfn " + mid + "(u64 x) -> u64 r {\n" + body + ";\n}\n";
+        if (!write(mid, source)) {
+            std::cerr << "compiler_bench: failed to write " << mid << std::endl;
+            return false;
+        }
+        out_root += "use \"" + use_path(mid) + "\";\n";
+    }
+    out_root += "\nfn main() -> u64 r {\n    r = 0";
+    for (size_t i = 0; i < width; ++i) {
+        out_root += " + mid_" + std::to_string(i) + "(r)";
+    }
+    out_root += ";\n}\n";
+    return true;
+}
+
+struct Measurement {
+    std::chrono::steady_clock::duration best { std::chrono::steady_clock::duration::max() };
+    uint64_t allocations { 0 };
+    uint64_t allocated_bytes { 0 };
+};
+
+// keeps the fastest run, and the allocations of the last one
+template<typename Fn>
+bool measure(Measurement& measurement, Fn fn) {
+    uint64_t allocations = TimeReport::thread_allocations();
+    uint64_t allocated_bytes = TimeReport::thread_allocated_bytes();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = fn();
+    auto duration = std::chrono::steady_clock::now() - start;
+    measurement.best = std::min(measurement.best, duration);
+    measurement.allocations = TimeReport::thread_allocations() - allocations;
+    measurement.allocated_bytes = TimeReport::thread_allocated_bytes() - allocated_bytes;
+    return ok;
+}
+
+void print_row(const std::string& corpus, const std::string& phase, const Measurement& measurement, size_t tokens, size_t bytes) {
+    double seconds = std::chrono::duration<double>(measurement.best).count();
+    double mb = double(bytes) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(18) << corpus << std::setw(10) << phase << std::right
+              << std::setw(10) << std::fixed << std::setprecision(3) << seconds * 1000.0
+              << std::setw(14) << std::setprecision(0) << (seconds > 0 ? double(tokens) / seconds : 0.0)
+              << std::setw(10) << std::setprecision(2) << (seconds > 0 ? mb / seconds : 0.0)
+              << std::setw(12) << measurement.allocations
+              << std::setw(12) << measurement.allocated_bytes / 1024 << "\n";
+}
+
+bool run_corpus(const Corpus& corpus) {
+    Options options;
+    options.jobs = s_options.jobs;
+    Measurement tokenize_time, parse_time, codegen_time;
+    size_t token_count = 0;
+    for (size_t i = 0; i < s_options.iterations; ++i) {
+        std::vector<Token> tokens;
+        measure(tokenize_time, [&] {
+            tokens = tokenize_source(corpus.source);
+            return true;
+        });
+        token_count = tokens.size();
+
+        std::shared_ptr<AST::Unit> unit;
+        bool parsed = measure(parse_time, [&] {
+            AST::Parser parser(tokens);
+            unit = parser.unit();
+            return parser.error_count() == 0;
+        });
+        if (!parsed) {
+            std::cerr << "compiler_bench: corpus '" << corpus.name << "' has syntax errors" << std::endl;
+            return false;
+        }
+
+        std::string asm_source;
+        bool compiled = measure(codegen_time, [&] {
+            return compile_to_asm(unit, corpus.name + ".xc", options, asm_source);
+        });
+        if (!compiled) {
+            std::cerr << "compiler_bench: failed to compile corpus '" << corpus.name << "'" << std::endl;
+            return false;
+        }
+    }
+    // codegen throughput is in terms of the root's source, used modules are
+    // compiled on top
+    print_row(corpus.name, "tokenize", tokenize_time, token_count, corpus.source.size());
+    print_row(corpus.name, "parse", parse_time, token_count, corpus.source.size());
+    print_row(corpus.name, "codegen", codegen_time, token_count, corpus.source.size());
+    return true;
+}
+
+bool parse_size(const std::string& arg, const std::string& prefix, size_t& out) {
+    auto value = arg.substr(prefix.size());
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (ec != std::errc() || end != value.data() + value.size() || out == 0) {
+        std::cerr << "compiler_bench: invalid value in '" << arg << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--iterations=")) {
+            if (!parse_size(arg, "--iterations=", s_options.iterations)) {
+                return 1;
+            }
+        } else if (arg.starts_with("--scale=")) {
+            if (!parse_size(arg, "--scale=", s_options.scale)) {
+                return 1;
+            }
+        } else if (arg.starts_with("-j")) {
+            if (!parse_size(arg, "-j", s_options.jobs)) {
+                return 1;
+            }
+        } else if (arg.starts_with("--corpus-dir=")) {
+            s_options.corpus_dir = arg.substr(std::strlen("--corpus-dir="));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--iterations=N] [--scale=N] [-j<n>] [--corpus-dir=DIR]" << std::endl;
+            return 1;
+        }
+    }
+
+    // formatting the compiler's progress messages would be measured too
+    Trace::set_log_level(XC_LOG_LEVEL_WARNING);
+
+    size_t scale = s_options.scale;
+    std::vector<Corpus> corpora {
+        { "deep-nesting", generate_deep_nesting(50 * scale, 40) },
+        { "wide-functions", generate_wide_functions(50 * scale, 60) },
+        { "string-literals", generate_string_literals(50 * scale, 100) },
+    };
+    auto& graph = corpora.emplace_back(Corpus { "import-graph", "" });
+    if (!generate_import_graph(20 * scale, 4, graph.source)) {
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(18) << "corpus" << std::setw(10) << "phase" << std::right
+              << std::setw(10) << "best ms" << std::setw(14) << "tokens/s" << std::setw(10) << "MB/s"
+              << std::setw(12) << "allocs" << std::setw(12) << "KiB" << "\n";
+    for (const auto& corpus : corpora) {
+        if (!run_corpus(corpus)) {
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,394 @@
+// Compiles the programs in bench/workloads, runs them and measures how fast
+// they are, so codegen changes get a performance verdict.
+//
+//     runtime_bench [--compiler=PATH] [--flags="-O2 ..."] [--runs=N]
+//                   [--baseline=FILE] [--write-baseline=FILE] [--tolerance=PCT]
+//
+// Run it from the repository root, since the compiler finds asm/ and std/
+// relative to the working directory. Cycles, instructions and branch misses
+// are counted with perf_event_open when the kernel allows it, otherwise only
+// the wall-clock time is measured. Each metric is the median of all runs.
+//
+// A baseline is a text file with one "<workload> <metric> <value>" per line.
+// A workload fails when one of its metrics is more than the tolerance above
+// the baseline. Instructions and cycles are compared when they were counted,
+// and the wall-clock time only when they weren't, since it's noisier.
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef XC_COMPILER_PATH
+#    define XC_COMPILER_PATH "./compiler"
+#endif
+
+namespace {
+
+struct Workload {
+    const char* name;
+    // what main returns, modulo 256, checked so a miscompile can't pass as a
+    // speedup
+    int expected_exit_code;
+};
+
+constexpr Workload s_workloads[] = {
+    { "string_scan", 104 },
+    { "arithmetic", 174 },
+    { "recursion", 168 },
+    { "dispatch", 101 },
+    // six arguments leave few registers for the values of branchless ifs
+    { "register_pressure", 244 },
+};
+
+struct Options {
+    std::string compiler { XC_COMPILER_PATH };
+    std::vector<std::string> flags {};
+    std::string workloads_dir { "bench/workloads" };
+    // sources are copied here, so the binaries and .asm files end up here too
+    std::string work_dir { "runtime_bench_out" };
+    size_t runs { 5 };
+    std::string baseline {};
+    std::string write_baseline {};
+    double tolerance_percent { 3.0 };
+};
+
+Options s_options;
+
+struct Counter {
+    const char* metric;
+    uint64_t config;
+};
+
+constexpr Counter s_counters[] = {
+    { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch-misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+// metrics compared against the baseline, the first ones available are used
+constexpr const char* s_gated_metrics[] = { "instructions", "cycles" };
+
+bool s_counters_available = true;
+
+// metric -> value, of one run or the median of all of them
+using Metrics = std::map<std::string, double>;
+
+int open_counter(pid_t pid, uint64_t config) {
+    perf_event_attr attr {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    // counts from the exec on, so the fork and the wait for the counters
+    // don't show up
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+}
+
+// runs `argv` with stdout and stderr going to `log`, returns its exit code or
+// -1 if it couldn't be run
+int run_process(const std::vector<std::string>& argv, const std::string& log, Metrics* out_metrics) {
+    int go[2];
+    if (pipe(go) != 0) {
+        std::cerr << "runtime_bench: pipe: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "runtime_bench: fork: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    if (pid == 0) {
+        close(go[1]);
+        // waits until the counters are attached
+        char byte;
+        if (read(go[0], &byte, 1) != 1) {
+            _exit(127);
+        }
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        std::vector<char*> args;
+        for (const auto& arg : argv) {
+            args.push_back(const_cast<char*>(arg.c_str()));
+        }
+        args.push_back(nullptr);
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    close(go[0]);
+
+    std::vector<int> fds;
+    if (out_metrics && s_counters_available) {
+        for (const auto& counter : s_counters) {
+            int fd = open_counter(pid, counter.config);
+            if (fd < 0) {
+                std::cerr << "runtime_bench: perf_event_open: " << std::strerror(errno) << ", only measuring wall-clock time" << std::endl;
+                s_counters_available = false;
+                break;
+            }
+            fds.push_back(fd);
+        }
+        if (!s_counters_available) {
+            for (int fd : fds) {
+                close(fd);
+            }
+            fds.clear();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    char byte = 0;
+    bool started = write(go[1], &byte, 1) == 1;
+    close(go[1]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    auto duration = std::chrono::steady_clock::now() - start;
+
+    if (out_metrics) {
+        (*out_metrics)["wall-ns"] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        for (size_t i = 0; i < fds.size(); ++i) {
+            uint64_t value = 0;
+            if (read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+                (*out_metrics)[s_counters[i].metric] = double(value);
+            }
+            close(fds[i]);
+        }
+    }
+    if (!started || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+bool measure_workload(const Workload& workload, Metrics& out_metrics) {
+    std::error_code ec;
+    auto source = std::filesystem::path(s_options.work_dir) / (std::string(workload.name) + ".xc");
+    std::filesystem::copy_file(std::filesystem::path(s_options.workloads_dir) / (std::string(workload.name) + ".xc"), source, std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+        std::cerr << "runtime_bench: failed to copy " << workload.name << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> compile { s_options.compiler };
+    compile.insert(compile.end(), s_options.flags.begin(), s_options.flags.end());
+    compile.push_back(source.string());
+    auto compile_log = (std::filesystem::path(s_options.work_dir) / (std::string(workload.name) + ".compile.log")).string();
+    if (run_process(compile, compile_log, nullptr) != 0) {
+        std::cerr << "runtime_bench: failed to compile " << workload.name << ", see " << compile_log << std::endl;
+        return false;
+    }
+
+    auto binary = (std::filesystem::path(s_options.work_dir) / workload.name).string();
+    auto run_log = binary + ".run.log";
+    std::map<std::string, std::vector<double>> samples;
+    for (size_t i = 0; i < s_options.runs; ++i) {
+        Metrics metrics;
+        int exit_code = run_process({ binary }, run_log, &metrics);
+        if (exit_code != workload.expected_exit_code) {
+            std::cerr << "runtime_bench: " << workload.name << " exited with " << exit_code << ", expected " << workload.expected_exit_code << std::endl;
+            return false;
+        }
+        for (const auto& [metric, value] : metrics) {
+            samples[metric].push_back(value);
+        }
+    }
+    for (const auto& [metric, values] : samples) {
+        // a counter may have failed to read in some of the runs
+        if (values.size() == s_options.runs) {
+            out_metrics[metric] = median(values);
+        }
+    }
+    return true;
+}
+
+bool read_baseline(const std::string& path, std::map<std::string, Metrics>& out) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "runtime_bench: failed to open \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (line.empty() || line.starts_with('#')) {
+            continue;
+        }
+        std::istringstream words(line);
+        std::string workload, metric;
+        double value;
+        if (!(words >> workload >> metric >> value)) {
+            std::cerr << path << ":" << line_number << ": expected \"<workload> <metric> <value>\"" << std::endl;
+            return false;
+        }
+        out[workload][metric] = value;
+    }
+    return true;
+}
+
+bool write_baseline(const std::string& path, const std::map<std::string, Metrics>& results) {
+    std::ofstream file(path);
+    file << "# written by runtime_bench";
+    for (const auto& flag : s_options.flags) {
+        file << " " << flag;
+    }
+    file << "\n";
+    for (const auto& [workload, metrics] : results) {
+        for (const auto& [metric, value] : metrics) {
+            file << workload << " " << metric << " " << std::fixed << std::setprecision(0) << value << "\n";
+        }
+    }
+    if (!file) {
+        std::cerr << "runtime_bench: failed to write \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// prints a verdict per workload, returns whether all of them passed
+bool compare_to_baseline(const std::map<std::string, Metrics>& results, const std::map<std::string, Metrics>& baseline) {
+    bool passed = true;
+    for (const auto& [workload, metrics] : results) {
+        auto expected = baseline.find(workload);
+        if (expected == baseline.end()) {
+            std::cout << std::left << std::setw(14) << workload << "  no baseline\n";
+            continue;
+        }
+        std::vector<std::string> gated;
+        for (const char* metric : s_gated_metrics) {
+            if (metrics.contains(metric) && expected->second.contains(metric)) {
+                gated.push_back(metric);
+            }
+        }
+        if (gated.empty() && metrics.contains("wall-ns") && expected->second.contains("wall-ns")) {
+            gated.push_back("wall-ns");
+        }
+        bool workload_passed = true;
+        std::ostringstream changes;
+        for (const auto& metric : gated) {
+            double change = 100.0 * (metrics.at(metric) / expected->second.at(metric) - 1.0);
+            changes << "  " << metric << " " << std::showpos << std::fixed << std::setprecision(1) << change << "%" << std::noshowpos;
+            if (change > s_options.tolerance_percent) {
+                workload_passed = false;
+            }
+        }
+        std::cout << std::left << std::setw(14) << workload << (gated.empty() ? "  no comparable metrics" : workload_passed ? "  PASS" : "  FAIL") << changes.str() << "\n";
+        passed = passed && workload_passed;
+    }
+    return passed;
+}
+
+bool parse_number(const std::string& arg, const std::string& prefix, size_t& out) {
+    auto value = arg.substr(prefix.size());
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+    if (ec != std::errc() || end != value.data() + value.size() || out == 0) {
+        std::cerr << "runtime_bench: invalid value in '" << arg << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--compiler=")) {
+            s_options.compiler = arg.substr(std::strlen("--compiler="));
+        } else if (arg.starts_with("--flags=")) {
+            std::istringstream flags(arg.substr(std::strlen("--flags=")));
+            std::string flag;
+            while (flags >> flag) {
+                s_options.flags.push_back(flag);
+            }
+        } else if (arg.starts_with("--runs=")) {
+            if (!parse_number(arg, "--runs=", s_options.runs)) {
+                return 1;
+            }
+        } else if (arg.starts_with("--baseline=")) {
+            s_options.baseline = arg.substr(std::strlen("--baseline="));
+        } else if (arg.starts_with("--write-baseline=")) {
+            s_options.write_baseline = arg.substr(std::strlen("--write-baseline="));
+        } else if (arg.starts_with("--tolerance=")) {
+            s_options.tolerance_percent = std::atof(arg.c_str() + std::strlen("--tolerance="));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--compiler=PATH] [--flags=\"...\"] [--runs=N] [--baseline=FILE] [--write-baseline=FILE] [--tolerance=PCT]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(s_options.work_dir, ec);
+    if (ec) {
+        std::cerr << "runtime_bench: failed to create \"" << s_options.work_dir << "\": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, Metrics> results;
+    std::cout << std::left << std::setw(14) << "workload" << std::right << std::setw(12) << "wall ms" << std::setw(16) << "cycles"
+              << std::setw(16) << "instructions" << std::setw(14) << "branch-misses" << "\n";
+    for (const auto& workload : s_workloads) {
+        Metrics metrics;
+        if (!measure_workload(workload, metrics)) {
+            return 1;
+        }
+        auto print = [&](const char* metric, int width) {
+            auto iter = metrics.find(metric);
+            if (iter == metrics.end()) {
+                std::cout << std::setw(width) << "-";
+            } else {
+                std::cout << std::setw(width) << std::fixed << std::setprecision(0) << iter->second;
+            }
+        };
+        std::cout << std::left << std::setw(14) << workload.name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << metrics["wall-ns"] / 1e6;
+        print("cycles", 16);
+        print("instructions", 16);
+        print("branch-misses", 14);
+        std::cout << "\n";
+        results[workload.name] = std::move(metrics);
+    }
+
+    if (!s_options.write_baseline.empty() && !write_baseline(s_options.write_baseline, results)) {
+        return 1;
+    }
+    if (!s_options.baseline.empty()) {
+        std::map<std::string, Metrics> baseline;
+        if (!read_baseline(s_options.baseline, baseline)) {
+            return 1;
+        }
+        std::cout << "\ncompared to " << s_options.baseline << ", tolerance " << s_options.tolerance_percent << "%:\n";
+        if (!compare_to_baseline(results, baseline)) {
+            std::cout << "performance regression\n";
+            return 1;
+        }
+        std::cout << "no performance regression\n";
+    }
+}
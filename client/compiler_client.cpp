@@ -0,0 +1,43 @@
+// Forwards a build to a compile server started with `compiler --daemon`, and
+// exits with the build's exit code, as if the compiler had been run with the
+// same arguments in the same directory.
+//
+//     compiler_client [--socket=PATH] <compiler arguments>
+//     compiler_client [--socket=PATH] --stop
+
+#include "Server.h"
+
+#include <lk/Logger.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    lk::Logger::the().add_stream(std::cout);
+
+    std::string socket_path = Server::default_socket_path();
+    bool stop = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        // everything after the first argument of the compiler is passed on
+        if (args.empty() && arg.starts_with("--socket=")) {
+            socket_path = arg.substr(std::strlen("--socket="));
+        } else if (args.empty() && arg == "--stop") {
+            stop = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (stop) {
+        return Server::stop(socket_path) ? 0 : 1;
+    }
+    int exit_code = 1;
+    if (!Server::forward(socket_path, args, exit_code)) {
+        return 1;
+    }
+    return exit_code;
+}
@@ -11,6 +11,7 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <type_traits>
 #include <variant>
 
 using namespace AST;
@@ -41,8 +42,39 @@ std::shared_ptr<Unit> Parser::unit() {
     return result;
 }
 
+// FNV-1a over the types and values of the tokens
+uint64_t Parser::fingerprint(size_t begin, size_t end) const {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t size) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    for (size_t i = begin; i < end && i < m_tokens.size(); ++i) {
+        const auto& token = m_tokens[i];
+        mix(&token.type, sizeof(token.type));
+        std::visit([&](const auto& value) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>) {
+                uint64_t size = value.size();
+                mix(&size, sizeof(size));
+                mix(value.data(), value.size());
+            } else {
+                mix(&value, sizeof(value));
+            }
+        },
+            token.value);
+    }
+    return hash;
+}
+
 std::shared_ptr<FunctionDecl> Parser::function_decl() {
     auto result = std::make_shared<FunctionDecl>();
+    size_t begin = m_i;
+    if (check(Token::Type::PureKeyword)) {
+        advance();
+        result->is_pure = true;
+    }
     if (!match({ Token::Type::FnKeyword })) {
         return nullptr;
     }
@@ -73,6 +105,7 @@ std::shared_ptr<FunctionDecl> Parser::function_decl() {
     if (!result->body) {
         return nullptr;
     }
+    result->fingerprint = fingerprint(begin, m_i);
     return result;
 }
 
@@ -143,6 +176,8 @@ std::shared_ptr<Statement> Parser::statement() {
         }
     } else if (check(Token::Type::IfKeyword)) {
         result->statement = if_statement();
+    } else if (check(Token::Type::MatchKeyword)) {
+        result->statement = match_statement();
     } else {
         result->statement = assignment();
         if (!match({ Token::Type::Semicolon })) {
@@ -192,6 +227,58 @@ std::shared_ptr<ElseStatement> Parser::else_statement() {
     return result;
 }
 
+std::shared_ptr<MatchStatement> Parser::match_statement() {
+    auto result = std::make_shared<MatchStatement>();
+    if (!match({ Token::Type::MatchKeyword, Token::Type::OpeningParentheses })) {
+        return nullptr;
+    }
+    result->condition = expression();
+    if (!result->condition) {
+        return nullptr;
+    }
+    if (!match({ Token::Type::ClosingParentheses, Token::Type::OpeningBrace })) {
+        return nullptr;
+    }
+    while (check(Token::Type::NumericLiteral)) {
+        auto next_case = match_case();
+        if (!next_case) {
+            return nullptr;
+        }
+        result->cases.push_back(next_case);
+    }
+    if (check(Token::Type::ElseKeyword)) {
+        result->else_statement = else_statement();
+        if (!result->else_statement) {
+            return nullptr;
+        }
+    }
+    if (!match({ Token::Type::ClosingBrace })) {
+        return nullptr;
+    }
+    return result;
+}
+
+std::shared_ptr<MatchCase> Parser::match_case() {
+    auto result = std::make_shared<MatchCase>();
+    for (;;) {
+        auto literal = numeric_literal();
+        if (!literal) {
+            return nullptr;
+        }
+        result->values.push_back(literal->value);
+        if (check(Token::Type::Comma)) {
+            advance();
+        } else {
+            break;
+        }
+    }
+    result->body = body();
+    if (!result->body) {
+        return nullptr;
+    }
+    return result;
+}
+
 // TODO statements should be (statement)* on body
 std::shared_ptr<Statements> Parser::statements() {
     auto result = std::make_shared<Statements>();
@@ -230,6 +317,7 @@ std::shared_ptr<Identifier> Parser::identifier() {
         return nullptr;
     }
     result->name = std::get<std::string>(current().value);
+    result->symbol = current().symbol;
     advance();
     return result;
 }
@@ -451,7 +539,8 @@ Token Parser::previous() {
 
 Token Parser::peek() {
     if (m_i + 1 >= m_tokens.size()) {
-        return Token { Token::Type::EndOfUnit, "", m_tokens[m_i].line };
+        // past the last token once it was consumed
+        return Token { Token::Type::EndOfUnit, "", m_tokens.empty() ? 0 : m_tokens[std::min(m_i, m_tokens.size() - 1)].line };
     } else {
         return m_tokens[m_i + 1];
     }
@@ -490,6 +579,18 @@ std::string Expression::to_string(size_t level) {
     return "Expression\n" + indent(level) + term->to_string(level + 1);
 }
 
+Node* Expression::primary_value() const {
+    if (term->factors.size() != 1 || term->factors.front()->unaries.size() != 1) {
+        return nullptr;
+    }
+    const auto& unary = term->factors.front()->unaries.front();
+    auto primary = dynamic_cast<Primary*>(unary->unary_or_primary.get());
+    if (!unary->op.empty() || !primary) {
+        return nullptr;
+    }
+    return primary->value.get();
+}
+
 std::string Term::to_string(size_t level) {
     std::string res = "Term\n";
     ssize_t k = -1;
@@ -583,7 +684,7 @@ std::string VariableDeclList::to_string(size_t level) {
 }
 
 std::string FunctionDecl::to_string(size_t level) {
-    std::string res = "Function\n";
+    std::string res = is_pure ? "PureFunction\n" : "Function\n";
     res += indent(level) + name->to_string(level + 1);
     if (arguments) {
         res += indent(level) + "Arguments: " + arguments->to_string(level + 1);
@@ -637,3 +738,26 @@ std::string ElseStatement::to_string(size_t level) {
     res += indent(level) + body->to_string(level + 1);
     return res;
 }
+
+std::string MatchStatement::to_string(size_t level) {
+    std::string res = "MatchStatement\n";
+    res += indent(level) + "Condition:\n";
+    res += indent(level + 1) + condition->to_string(level + 1);
+    for (auto& match_case : cases) {
+        res += indent(level) + match_case->to_string(level + 1);
+    }
+    if (else_statement) {
+        res += indent(level) + else_statement->to_string(level + 1);
+    }
+    return res;
+}
+
+std::string MatchCase::to_string(size_t level) {
+    std::string res = "MatchCase:";
+    for (auto value : values) {
+        res += " " + std::to_string(value);
+    }
+    res += "\n";
+    res += indent(level) + body->to_string(level + 1);
+    return res;
+}
@@ -29,6 +29,8 @@ struct FunctionCall;
 struct UseDecl;
 struct IfStatement;
 struct ElseStatement;
+struct MatchStatement;
+struct MatchCase;
 
 struct Node {
     virtual ~Node() { }
@@ -49,6 +51,9 @@ struct Statement : public Node {
 struct Expression : public Node {
     std::shared_ptr<Term> term;
     virtual std::string to_string(size_t level);
+    // the literal, identifier or call the expression is made of, if that's
+    // all it is, else nullptr
+    Node* primary_value() const;
 };
 
 struct Term : public Node {
@@ -97,6 +102,7 @@ struct Body : public Node {
 
 struct Identifier : public Node {
     std::string name;
+    SymbolId symbol { Symbols::none };
     virtual std::string to_string(size_t level);
 };
 
@@ -131,6 +137,10 @@ struct FunctionDecl : public Node {
     std::shared_ptr<VariableDeclList> arguments;
     std::shared_ptr<VariableDecl> result;
     std::shared_ptr<Body> body;
+    bool is_pure { false };
+    // of its tokens without their lines, so it stays the same when the
+    // function only moves
+    uint64_t fingerprint { 0 };
     virtual std::string to_string(size_t level);
 };
 
@@ -157,6 +167,19 @@ struct ElseStatement : public Node {
     virtual std::string to_string(size_t level);
 };
 
+struct MatchStatement : public Node {
+    std::shared_ptr<Expression> condition;
+    std::vector<std::shared_ptr<MatchCase>> cases;
+    std::shared_ptr<ElseStatement> else_statement;
+    virtual std::string to_string(size_t level);
+};
+
+struct MatchCase : public Node {
+    std::vector<size_t> values;
+    std::shared_ptr<Body> body;
+    virtual std::string to_string(size_t level);
+};
+
 class Parser {
 public:
     Parser(const std::vector<Token>& tokens)
@@ -169,6 +192,8 @@ public:
     std::shared_ptr<Statement> statement();
     std::shared_ptr<IfStatement> if_statement();
     std::shared_ptr<ElseStatement> else_statement();
+    std::shared_ptr<MatchStatement> match_statement();
+    std::shared_ptr<MatchCase> match_case();
     std::shared_ptr<Statements> statements();
     std::shared_ptr<Assignment> assignment();
     std::shared_ptr<Identifier> identifier();
@@ -199,6 +224,7 @@ private:
     const Token& current() { return m_tokens[m_i]; }
     void error(const std::string& what);
     void error_expected(Token::Type expected);
+    uint64_t fingerprint(size_t begin, size_t end) const;
     size_t m_i { 0 };
     std::vector<Token> m_tokens;
     bool m_errors_enabled { true };
@@ -0,0 +1,702 @@
+#include "Assembler.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+struct RegisterInfo {
+    int index;
+    size_t size;
+};
+
+const std::unordered_map<std::string, RegisterInfo> s_registers = {
+    { "rax", { 0, 8 } }, { "rcx", { 1, 8 } }, { "rdx", { 2, 8 } }, { "rbx", { 3, 8 } },
+    { "rsp", { 4, 8 } }, { "rbp", { 5, 8 } }, { "rsi", { 6, 8 } }, { "rdi", { 7, 8 } },
+    { "r8", { 8, 8 } }, { "r9", { 9, 8 } }, { "r10", { 10, 8 } }, { "r11", { 11, 8 } },
+    { "r12", { 12, 8 } }, { "r13", { 13, 8 } }, { "r14", { 14, 8 } }, { "r15", { 15, 8 } },
+    { "eax", { 0, 4 } }, { "ecx", { 1, 4 } }, { "edx", { 2, 4 } }, { "ebx", { 3, 4 } },
+    { "esi", { 6, 4 } }, { "edi", { 7, 4 } },
+    { "r8d", { 8, 4 } }, { "r9d", { 9, 4 } }, { "r10d", { 10, 4 } }, { "r11d", { 11, 4 } },
+    // spl, bpl, sil and dil would need an empty REX prefix, and aren't used
+    { "al", { 0, 1 } }, { "cl", { 1, 1 } }, { "dl", { 2, 1 } }, { "bl", { 3, 1 } },
+    { "r8b", { 8, 1 } }, { "r9b", { 9, 1 } }, { "r10b", { 10, 1 } }, { "r11b", { 11, 1 } },
+};
+
+// second opcode byte of the rel32 form, after 0x0f
+const std::unordered_map<std::string, uint8_t> s_conditional_jumps = {
+    { "jo", 0x80 }, { "jno", 0x81 }, { "jb", 0x82 }, { "jc", 0x82 }, { "jae", 0x83 }, { "jnc", 0x83 },
+    { "je", 0x84 }, { "jz", 0x84 }, { "jne", 0x85 }, { "jnz", 0x85 }, { "jbe", 0x86 }, { "ja", 0x87 },
+    { "js", 0x88 }, { "jns", 0x89 }, { "jl", 0x8c }, { "jge", 0x8d }, { "jle", 0x8e }, { "jg", 0x8f },
+};
+
+// add, sub and cmp: (r/m, reg) opcode, (reg, r/m) opcode, /digit of the immediate forms
+struct ArithmeticInfo {
+    uint8_t rm_reg;
+    uint8_t reg_rm;
+    int digit;
+};
+
+const std::unordered_map<std::string, ArithmeticInfo> s_arithmetic = {
+    { "add", { 0x01, 0x03, 0 } },
+    { "or", { 0x09, 0x0b, 1 } },
+    { "and", { 0x21, 0x23, 4 } },
+    { "sub", { 0x29, 0x2b, 5 } },
+    { "xor", { 0x31, 0x33, 6 } },
+    { "cmp", { 0x39, 0x3b, 7 } },
+};
+
+std::string trim(const std::string& str) {
+    auto begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    auto end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+// everything before a `;` that isn't in a string
+std::string strip_comment(const std::string& line) {
+    bool in_string = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i] == '\'') {
+            in_string = !in_string;
+        } else if (line[i] == ';' && !in_string) {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+std::vector<std::string> split_operands(const std::string& text) {
+    std::vector<std::string> result;
+    bool in_string = false;
+    std::string current;
+    for (char c : text) {
+        if (c == '\'') {
+            in_string = !in_string;
+        }
+        if (c == ',' && !in_string) {
+            result.push_back(trim(current));
+            current.clear();
+        } else {
+            current += c;
+        }
+    }
+    if (!trim(current).empty()) {
+        result.push_back(trim(current));
+    }
+    return result;
+}
+
+bool parse_number(const std::string& text, int64_t& out) {
+    if (text.empty()) {
+        return false;
+    }
+    bool negative = text.front() == '-';
+    std::string digits = negative ? text.substr(1) : text;
+    int base = 10;
+    if (digits.starts_with("0x") || digits.starts_with("0X")) {
+        digits = digits.substr(2);
+        base = 16;
+    }
+    if (digits.empty()) {
+        return false;
+    }
+    uint64_t value {};
+    auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value, base);
+    if (ec != std::errc() || ptr != digits.data() + digits.size()) {
+        return false;
+    }
+    out = negative ? -int64_t(value) : int64_t(value);
+    return true;
+}
+
+bool is_identifier(const std::string& text) {
+    return !text.empty()
+        && (std::isalpha(text.front()) || text.front() == '_' || text.front() == '.')
+        && std::all_of(text.begin(), text.end(), [](char c) { return std::isalnum(c) || c == '_' || c == '.'; });
+}
+
+bool fits_int8(int64_t value) {
+    return value >= -128 && value <= 127;
+}
+
+bool fits_int32(int64_t value) {
+    return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+}
+
+}
+
+std::vector<uint8_t>& Assembler::Module::section(Section section) {
+    switch (section) {
+    case Section::Text:
+        return text;
+    case Section::Data:
+        return data;
+    case Section::Rodata:
+        return rodata;
+    }
+    return text;
+}
+
+const std::vector<uint8_t>& Assembler::Module::section(Section section) const {
+    return const_cast<Module*>(this)->section(section);
+}
+
+Assembler::Assembler(std::string include_dir)
+    : m_include_dir(std::move(include_dir)) {
+}
+
+bool Assembler::assemble(const std::string& source, const std::string& name, Module& out) {
+    out = Module {};
+    out.name = name;
+    m_module = &out;
+    m_section = Section::Text;
+    m_defines.clear();
+    bool ok = assemble_source(source, 0);
+    m_module = nullptr;
+    return ok;
+}
+
+bool Assembler::assemble_source(const std::string& source, size_t include_depth) {
+    std::istringstream stream(source);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!assemble_line(line, include_depth)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Assembler::assemble_line(const std::string& raw_line, size_t include_depth) {
+    m_current_line = raw_line;
+    auto line = trim(strip_comment(raw_line));
+    if (line.empty()) {
+        return true;
+    }
+    if (line.front() == '%') {
+        std::istringstream directive(line);
+        std::string name;
+        directive >> name;
+        if (name == "%define") {
+            std::string key;
+            directive >> key;
+            std::string value;
+            std::getline(directive, value);
+            m_defines[key] = trim(value);
+        } else if (name == "%undef") {
+            std::string key;
+            directive >> key;
+            m_defines.erase(key);
+        } else if (name == "%include") {
+            if (include_depth > 16) {
+                return error("%include nested too deeply");
+            }
+            auto quoted = trim(line.substr(name.size()));
+            if (quoted.size() < 2 || quoted.front() != '"' || quoted.back() != '"') {
+                return error("expected a quoted path");
+            }
+            auto path = std::filesystem::path(m_include_dir) / quoted.substr(1, quoted.size() - 2);
+            std::ifstream file(path);
+            if (!file) {
+                return error("failed to open \"" + path.string() + "\"");
+            }
+            std::stringstream contents;
+            contents << file.rdbuf();
+            return assemble_source(contents.str(), include_depth + 1);
+        } else {
+            return error("unsupported directive " + name);
+        }
+        return true;
+    }
+    line = expand_defines(line);
+
+    // `label:` optionally followed by an instruction or data on the same line
+    auto first_space = line.find_first_of(" \t");
+    auto first_word = line.substr(0, first_space);
+    if (first_word.size() > 1 && first_word.back() == ':') {
+        auto label = first_word.substr(0, first_word.size() - 1);
+        if (m_module->symbols.contains(label)) {
+            return error("label '" + label + "' defined twice");
+        }
+        m_module->symbols[label] = { m_section, m_module->section(m_section).size() };
+        if (first_space == std::string::npos) {
+            return true;
+        }
+        line = trim(line.substr(first_space));
+        first_space = line.find_first_of(" \t");
+        first_word = line.substr(0, first_space);
+    }
+    auto rest = first_space == std::string::npos ? std::string() : trim(line.substr(first_space));
+
+    if (first_word == "section") {
+        // attributes only matter to the linker
+        auto name = rest.substr(0, rest.find_first_of(" \t"));
+        if (name == ".text") {
+            m_section = Section::Text;
+        } else if (name == ".data") {
+            m_section = Section::Data;
+        } else if (name == ".rodata" || name.starts_with(".rodata.")) {
+            m_section = Section::Rodata;
+        } else {
+            return error("unknown section " + rest);
+        }
+        return true;
+    }
+    if (first_word == "global") {
+        for (const auto& name : split_operands(rest)) {
+            m_module->globals.insert(name);
+        }
+        return true;
+    }
+    if (first_word == "extern") {
+        // resolved when linking, anything undefined is looked up globally
+        return true;
+    }
+    if (first_word == "db") {
+        return assemble_data(1, split_operands(rest));
+    }
+    if (first_word == "dw") {
+        return assemble_data(2, split_operands(rest));
+    }
+    if (first_word == "dd") {
+        return assemble_data(4, split_operands(rest));
+    }
+    if (first_word == "dq") {
+        return assemble_data(8, split_operands(rest));
+    }
+    return assemble_instruction(first_word, split_operands(rest));
+}
+
+bool Assembler::assemble_data(size_t size, const std::vector<std::string>& items) {
+    for (const auto& item : items) {
+        if (item.size() >= 2 && item.front() == '\'' && item.back() == '\'') {
+            auto str = item.substr(1, item.size() - 2);
+            for (char c : str) {
+                emit_value(uint8_t(c), size);
+            }
+            continue;
+        }
+        int64_t value {};
+        if (parse_number(item, value)) {
+            emit_value(uint64_t(value), size);
+        } else if (is_identifier(item) && size == 8) {
+            emit_relocation(Relocation::Kind::Absolute64, item, 0, 8);
+        } else if (is_identifier(item) && size == 4) {
+            emit_relocation(Relocation::Kind::Absolute32, item, 0, 4);
+        } else {
+            return error("invalid data item '" + item + "'");
+        }
+    }
+    return true;
+}
+
+bool Assembler::assemble_instruction(const std::string& mnemonic, const std::vector<std::string>& operand_texts) {
+    std::vector<Operand> ops;
+    for (const auto& text : operand_texts) {
+        Operand op;
+        if (!parse_operand(text, op)) {
+            return false;
+        }
+        ops.push_back(op);
+    }
+    auto is = [&](size_t i, Operand::Kind kind) {
+        return i < ops.size() && ops.at(i).kind == kind;
+    };
+    auto is_reg = [&](size_t i) { return is(i, Operand::Kind::Register); };
+    auto is_mem = [&](size_t i) { return is(i, Operand::Kind::Memory); };
+    auto is_imm = [&](size_t i) { return is(i, Operand::Kind::Immediate); };
+    auto is_rm = [&](size_t i) { return is_reg(i) || is_mem(i); };
+    // operand size of a two operand instruction
+    auto size_of = [&]() -> size_t {
+        for (const auto& op : ops) {
+            if (op.size != 0) {
+                return op.size;
+            }
+        }
+        return 8;
+    };
+    auto bad_operands = [&]() {
+        return error("unsupported operands for " + mnemonic);
+    };
+
+    if (ops.empty()) {
+        if (mnemonic == "ret") {
+            emit({ 0xc3 });
+        } else if (mnemonic == "leave") {
+            emit({ 0xc9 });
+        } else if (mnemonic == "syscall") {
+            emit({ 0x0f, 0x05 });
+        } else if (mnemonic == "nop") {
+            emit({ 0x90 });
+        } else {
+            return error("unknown instruction " + mnemonic);
+        }
+        return true;
+    }
+
+    if ((mnemonic == "push" || mnemonic == "pop") && ops.size() == 1 && is_reg(0) && ops.at(0).size == 8) {
+        if (ops.at(0).reg >= 8) {
+            emit({ 0x41 });
+        }
+        emit({ uint8_t((mnemonic == "push" ? 0x50 : 0x58) + (ops.at(0).reg & 7)) });
+        return true;
+    }
+
+    if (mnemonic == "jmp" || mnemonic == "call") {
+        if (ops.size() != 1) {
+            return bad_operands();
+        }
+        if (is_imm(0) && !ops.at(0).symbol.empty()) {
+            emit({ uint8_t(mnemonic == "jmp" ? 0xe9 : 0xe8) });
+            emit_relocation(Relocation::Kind::Relative32, ops.at(0).symbol, -4, 4);
+            return true;
+        }
+        if (is_rm(0)) {
+            // no REX.W needed, these are 64 bit by default
+            return emit_modrm(false, { 0xff }, mnemonic == "jmp" ? 4 : 2, ops.at(0));
+        }
+        return bad_operands();
+    }
+    if (auto jcc = s_conditional_jumps.find(mnemonic); jcc != s_conditional_jumps.end()) {
+        if (ops.size() != 1 || !is_imm(0) || ops.at(0).symbol.empty()) {
+            return bad_operands();
+        }
+        emit({ 0x0f, jcc->second });
+        emit_relocation(Relocation::Kind::Relative32, ops.at(0).symbol, -4, 4);
+        return true;
+    }
+    if (ops.size() == 1) {
+        if ((mnemonic == "setz" || mnemonic == "sete" || mnemonic == "setnz" || mnemonic == "setne") && is_rm(0)) {
+            bool is_zero = mnemonic == "setz" || mnemonic == "sete";
+            return emit_modrm(false, { 0x0f, uint8_t(is_zero ? 0x94 : 0x95) }, 0, ops.at(0));
+        }
+        return bad_operands();
+    }
+    if (ops.size() != 2) {
+        return bad_operands();
+    }
+
+    bool wide = size_of() == 8;
+    if (mnemonic == "mov") {
+        if (is_rm(0) && is_reg(1)) {
+            return emit_modrm(wide, { 0x89 }, ops.at(1).reg, ops.at(0));
+        }
+        if (is_reg(0) && is_mem(1)) {
+            return emit_modrm(wide, { 0x8b }, ops.at(0).reg, ops.at(1));
+        }
+        if (is_reg(0) && is_imm(1) && (!ops.at(1).symbol.empty() || !fits_int32(ops.at(1).value)) && wide) {
+            // movabs, addresses are always 64 bit here
+            emit({ uint8_t(0x48 | (ops.at(0).reg >> 3)), uint8_t(0xb8 + (ops.at(0).reg & 7)) });
+            emit_immediate(ops.at(1), 8);
+            return true;
+        }
+        if (is_rm(0) && is_imm(1)) {
+            if (ops.at(1).symbol.empty() && !fits_int32(ops.at(1).value)) {
+                return error("immediate doesn't fit into 32 bits");
+            }
+            if (!emit_modrm(wide, { 0xc7 }, 0, ops.at(0))) {
+                return false;
+            }
+            emit_immediate(ops.at(1), 4);
+            return true;
+        }
+        return bad_operands();
+    }
+    if (mnemonic == "movzx") {
+        if (!is_reg(0) || !is_rm(1) || (ops.at(1).size != 1 && !(is_mem(1) && ops.at(1).size == 0))) {
+            return bad_operands();
+        }
+        return emit_modrm(ops.at(0).size == 8, { 0x0f, 0xb6 }, ops.at(0).reg, ops.at(1));
+    }
+    if (mnemonic == "lea") {
+        if (!is_reg(0) || !is_mem(1)) {
+            return bad_operands();
+        }
+        return emit_modrm(ops.at(0).size == 8, { 0x8d }, ops.at(0).reg, ops.at(1));
+    }
+    if (auto arithmetic = s_arithmetic.find(mnemonic); arithmetic != s_arithmetic.end()) {
+        const auto& info = arithmetic->second;
+        if (is_rm(0) && is_reg(1)) {
+            return emit_modrm(wide, { info.rm_reg }, ops.at(1).reg, ops.at(0));
+        }
+        if (is_reg(0) && is_mem(1)) {
+            return emit_modrm(wide, { info.reg_rm }, ops.at(0).reg, ops.at(1));
+        }
+        if (is_rm(0) && is_imm(1)) {
+            if (ops.at(1).symbol.empty() && fits_int8(ops.at(1).value)) {
+                if (!emit_modrm(wide, { 0x83 }, info.digit, ops.at(0))) {
+                    return false;
+                }
+                emit_immediate(ops.at(1), 1);
+                return true;
+            }
+            if (ops.at(1).symbol.empty() && !fits_int32(ops.at(1).value)) {
+                return error("immediate doesn't fit into 32 bits");
+            }
+            if (!emit_modrm(wide, { 0x81 }, info.digit, ops.at(0))) {
+                return false;
+            }
+            emit_immediate(ops.at(1), 4);
+            return true;
+        }
+        return bad_operands();
+    }
+    if (mnemonic == "imul") {
+        if (is_reg(0) && is_rm(1)) {
+            return emit_modrm(wide, { 0x0f, 0xaf }, ops.at(0).reg, ops.at(1));
+        }
+        if (is_reg(0) && is_imm(1) && ops.at(1).symbol.empty() && fits_int32(ops.at(1).value)) {
+            bool is_short = fits_int8(ops.at(1).value);
+            if (!emit_modrm(wide, { uint8_t(is_short ? 0x6b : 0x69) }, ops.at(0).reg, ops.at(0))) {
+                return false;
+            }
+            emit_immediate(ops.at(1), is_short ? 1 : 4);
+            return true;
+        }
+        return bad_operands();
+    }
+    if (mnemonic == "test") {
+        if (is_rm(0) && is_reg(1)) {
+            return emit_modrm(wide, { 0x85 }, ops.at(1).reg, ops.at(0));
+        }
+        return bad_operands();
+    }
+    if (mnemonic == "bt") {
+        if (is_rm(0) && is_reg(1)) {
+            return emit_modrm(wide, { 0x0f, 0xa3 }, ops.at(1).reg, ops.at(0));
+        }
+        return bad_operands();
+    }
+    if (mnemonic == "cmovz" || mnemonic == "cmove" || mnemonic == "cmovnz" || mnemonic == "cmovne") {
+        if (is_reg(0) && is_rm(1)) {
+            bool is_zero = mnemonic == "cmovz" || mnemonic == "cmove";
+            return emit_modrm(wide, { 0x0f, uint8_t(is_zero ? 0x44 : 0x45) }, ops.at(0).reg, ops.at(1));
+        }
+        return bad_operands();
+    }
+    return error("unknown instruction " + mnemonic);
+}
+
+bool Assembler::parse_operand(const std::string& raw_text, Operand& out) {
+    out = Operand {};
+    auto text = trim(raw_text);
+    for (const auto& [prefix, size] : { std::pair { "qword ", 8 }, { "dword ", 4 }, { "word ", 2 }, { "byte ", 1 } }) {
+        if (text.starts_with(prefix)) {
+            out.size = size;
+            text = trim(text.substr(std::string(prefix).size()));
+            break;
+        }
+    }
+    if (!text.empty() && text.front() == '[') {
+        if (text.back() != ']') {
+            return error("expected ']'");
+        }
+        out.kind = Operand::Kind::Memory;
+        return parse_memory(text.substr(1, text.size() - 2), out);
+    }
+    if (auto reg = s_registers.find(text); reg != s_registers.end()) {
+        out.kind = Operand::Kind::Register;
+        out.reg = reg->second.index;
+        out.size = reg->second.size;
+        return true;
+    }
+    out.kind = Operand::Kind::Immediate;
+    if (parse_number(text, out.value)) {
+        return true;
+    }
+    if (is_identifier(text)) {
+        out.symbol = text;
+        return true;
+    }
+    return error("invalid operand '" + text + "'");
+}
+
+bool Assembler::parse_memory(const std::string& text, Operand& out) {
+    // terms of `base + index*scale + symbol + displacement`, in any order
+    size_t i = 0;
+    while (i < text.size()) {
+        int sign = 1;
+        while (i < text.size() && (text[i] == '+' || text[i] == '-' || std::isspace(text[i]))) {
+            if (text[i] == '-') {
+                sign = -sign;
+            }
+            ++i;
+        }
+        size_t end = text.find_first_of("+-", i);
+        auto term = trim(text.substr(i, end == std::string::npos ? std::string::npos : end - i));
+        i = end == std::string::npos ? text.size() : end;
+        if (term.empty()) {
+            continue;
+        }
+        auto star = term.find('*');
+        if (star != std::string::npos) {
+            auto left = trim(term.substr(0, star));
+            auto right = trim(term.substr(star + 1));
+            if (s_registers.contains(right)) {
+                std::swap(left, right);
+            }
+            auto reg = s_registers.find(left);
+            int64_t scale {};
+            if (reg == s_registers.end() || !parse_number(right, scale) || sign < 0 || out.index != -1
+                || (scale != 1 && scale != 2 && scale != 4 && scale != 8) || reg->second.index == 4) {
+                return error("invalid index '" + term + "'");
+            }
+            out.index = reg->second.index;
+            out.scale = int(scale);
+            continue;
+        }
+        if (auto reg = s_registers.find(term); reg != s_registers.end()) {
+            if (sign < 0 || reg->second.size != 8) {
+                return error("invalid base '" + term + "'");
+            }
+            if (out.base == -1) {
+                out.base = reg->second.index;
+            } else if (out.index == -1 && reg->second.index != 4) {
+                out.index = reg->second.index;
+            } else {
+                return error("too many registers in address");
+            }
+            continue;
+        }
+        int64_t value {};
+        if (parse_number(term, value)) {
+            out.value += sign * value;
+            continue;
+        }
+        if (is_identifier(term) && sign > 0 && out.symbol.empty()) {
+            out.symbol = term;
+            continue;
+        }
+        return error("invalid address term '" + term + "'");
+    }
+    return true;
+}
+
+std::string Assembler::expand_defines(const std::string& text) const {
+    if (m_defines.empty()) {
+        return text;
+    }
+    std::string result;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (std::isalpha(text[i]) || text[i] == '_') {
+            size_t end = i;
+            while (end < text.size() && (std::isalnum(text[end]) || text[end] == '_')) {
+                ++end;
+            }
+            auto word = text.substr(i, end - i);
+            auto define = m_defines.find(word);
+            result += define == m_defines.end() ? word : define->second;
+            i = end;
+        } else if (text[i] == '\'') {
+            auto end = text.find('\'', i + 1);
+            end = end == std::string::npos ? text.size() : end + 1;
+            result += text.substr(i, end - i);
+            i = end;
+        } else {
+            result += text[i++];
+        }
+    }
+    return result;
+}
+
+void Assembler::emit(std::initializer_list<uint8_t> bytes) {
+    auto& section = m_module->section(m_section);
+    section.insert(section.end(), bytes.begin(), bytes.end());
+}
+
+void Assembler::emit_value(uint64_t value, size_t size) {
+    auto& section = m_module->section(m_section);
+    for (size_t i = 0; i < size; ++i) {
+        section.push_back(uint8_t(value >> (8 * i)));
+    }
+}
+
+void Assembler::emit_relocation(Relocation::Kind kind, const std::string& symbol, int64_t addend, size_t size) {
+    m_module->relocations.push_back({ kind, m_section, m_module->section(m_section).size(), symbol, addend });
+    emit_value(0, size);
+}
+
+bool Assembler::emit_modrm(bool wide, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) << 2);
+    if (rm.kind == Operand::Kind::Register) {
+        rex |= rm.reg >> 3;
+    } else {
+        rex |= rm.base >= 0 ? rm.base >> 3 : 0;
+        rex |= rm.index >= 0 ? (rm.index >> 3) << 1 : 0;
+    }
+    if (rex != 0x40) {
+        emit({ rex });
+    }
+    emit(opcode);
+
+    uint8_t reg_bits = uint8_t((reg & 7) << 3);
+    if (rm.kind == Operand::Kind::Register) {
+        emit({ uint8_t(0xc0 | reg_bits | (rm.reg & 7)) });
+        return true;
+    }
+    if (rm.kind != Operand::Kind::Memory) {
+        return error("expected a register or memory operand");
+    }
+    uint8_t scale_bits = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+    if (rm.base == -1) {
+        // absolute [disp32] or [index*scale + disp32], through a SIB without base
+        emit({ uint8_t(reg_bits | 0x04) });
+        uint8_t index_bits = rm.index == -1 ? 0x04 : uint8_t(rm.index & 7);
+        emit({ uint8_t((scale_bits << 6) | (index_bits << 3) | 0x05) });
+    } else {
+        // rbp and r13 can't go without displacement, rsp and r12 need a SIB
+        bool needs_sib = rm.index != -1 || (rm.base & 7) == 4;
+        uint8_t mod;
+        if (!rm.symbol.empty() || !fits_int8(rm.value)) {
+            mod = 0x80;
+        } else if (rm.value != 0 || (rm.base & 7) == 5) {
+            mod = 0x40;
+        } else {
+            mod = 0x00;
+        }
+        emit({ uint8_t(mod | reg_bits | (needs_sib ? 0x04 : (rm.base & 7))) });
+        if (needs_sib) {
+            uint8_t index_bits = rm.index == -1 ? 0x04 : uint8_t(rm.index & 7);
+            emit({ uint8_t((scale_bits << 6) | (index_bits << 3) | (rm.base & 7)) });
+        }
+        if (mod == 0x40) {
+            emit_value(uint64_t(rm.value), 1);
+            return true;
+        }
+        if (mod == 0x00) {
+            return true;
+        }
+    }
+    if (!rm.symbol.empty()) {
+        emit_relocation(Relocation::Kind::Absolute32, rm.symbol, rm.value, 4);
+    } else if (!fits_int32(rm.value)) {
+        return error("displacement doesn't fit into 32 bits");
+    } else {
+        emit_value(uint64_t(rm.value), 4);
+    }
+    return true;
+}
+
+void Assembler::emit_immediate(const Operand& imm, size_t size) {
+    if (!imm.symbol.empty()) {
+        emit_relocation(size == 8 ? Relocation::Kind::Absolute64 : Relocation::Kind::Absolute32, imm.symbol, imm.value, size);
+    } else {
+        emit_value(uint64_t(imm.value), size);
+    }
+}
+
+bool Assembler::error(const std::string& what) {
+    lk::log::error() << "assembler: " << (m_module ? m_module->name : "") << ": " << what << " in '" << trim(m_current_line) << "'" << std::endl;
+    return false;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Assembles the subset of NASM the compiler and asm/lib emit into machine
+// code, without going through nasm and ld.
+class Assembler {
+public:
+    enum class Section {
+        Text,
+        Data,
+        Rodata,
+    };
+
+    struct Symbol {
+        Section section { Section::Text };
+        size_t offset { 0 };
+    };
+
+    struct Relocation {
+        enum class Kind {
+            // 32 bit displacement to the end of the field, for jumps and calls
+            Relative32,
+            // absolute address, sign-extended from 32 bits
+            Absolute32,
+            Absolute64,
+        };
+
+        Kind kind { Kind::Absolute64 };
+        Section section { Section::Text };
+        size_t offset { 0 };
+        std::string symbol;
+        int64_t addend { 0 };
+    };
+
+    // the equivalent of one object file
+    struct Module {
+        std::string name;
+        std::vector<uint8_t> text;
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> rodata;
+        std::unordered_map<std::string, Symbol> symbols;
+        std::unordered_set<std::string> globals;
+        std::vector<Relocation> relocations;
+
+        std::vector<uint8_t>& section(Section section);
+        const std::vector<uint8_t>& section(Section section) const;
+    };
+
+    // %include paths are relative to `include_dir`, like nasm's -I
+    explicit Assembler(std::string include_dir = ".");
+
+    bool assemble(const std::string& source, const std::string& name, Module& out);
+
+private:
+    struct Operand {
+        enum class Kind {
+            Register,
+            Memory,
+            Immediate,
+        };
+
+        Kind kind { Kind::Immediate };
+        // in bytes, 0 if not given
+        size_t size { 0 };
+        int reg { -1 };
+        int base { -1 };
+        int index { -1 };
+        int scale { 1 };
+        int64_t value { 0 };
+        std::string symbol;
+    };
+
+    bool assemble_source(const std::string& source, size_t include_depth);
+    bool assemble_line(const std::string& line, size_t include_depth);
+    bool assemble_instruction(const std::string& mnemonic, const std::vector<std::string>& operands);
+    bool assemble_data(size_t size, const std::vector<std::string>& items);
+
+    bool parse_operand(const std::string& text, Operand& out);
+    bool parse_memory(const std::string& text, Operand& out);
+    std::string expand_defines(const std::string& text) const;
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit_value(uint64_t value, size_t size);
+    void emit_relocation(Relocation::Kind kind, const std::string& symbol, int64_t addend, size_t size);
+    // REX prefix, opcode, ModRM and everything the r/m operand needs
+    bool emit_modrm(bool wide, std::initializer_list<uint8_t> opcode, int reg, const Operand& rm);
+    void emit_immediate(const Operand& imm, size_t size);
+
+    bool error(const std::string& what);
+
+    std::string m_include_dir;
+    Module* m_module { nullptr };
+    Section m_section { Section::Text };
+    std::unordered_map<std::string, std::string> m_defines {};
+    std::string m_current_line;
+};
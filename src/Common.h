@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Symbols.h"
+
 #include <cstdint>
 #include <ostream>
 #include <string>
@@ -10,6 +12,7 @@ struct Token {
     enum class Type {
         Typename,
         FnKeyword,
+        PureKeyword,
         ArrowOperator,
         Identifier,
         OpeningParentheses,
@@ -28,12 +31,15 @@ struct Token {
         UseKeyword,
         IfKeyword,
         ElseKeyword,
+        MatchKeyword,
         // special types!
         EndOfUnit,
         StartOfUnit,
     } type;
     std::variant<size_t, char, std::string> value;
     size_t line;
+    // interned name of identifiers
+    SymbolId symbol { Symbols::none };
 };
 
 static inline std::ostream& operator<<(std::ostream& os, const Token::Type& type) {
@@ -41,12 +47,18 @@ static inline std::ostream& operator<<(std::ostream& os, const Token::Type& type
     case Token::Type::FnKeyword:
         os << "keyword 'fn'";
         break;
+    case Token::Type::PureKeyword:
+        os << "keyword 'pure'";
+        break;
     case Token::Type::IfKeyword:
         os << "keyword 'if'";
         break;
     case Token::Type::ElseKeyword:
         os << "keyword 'else'";
         break;
+    case Token::Type::MatchKeyword:
+        os << "keyword 'match'";
+        break;
     case Token::Type::ArrowOperator:
         os << "operator '->'";
         break;
@@ -113,4 +125,11 @@ static inline const std::vector<std::string> typenames = {
     "u64",
     "bool",
     "char",
+    "str",
+};
+
+// builtins that give the pointer and the length of a str, without a call
+static inline const std::vector<std::string> str_builtins = {
+    "str_ptr",
+    "str_len",
 };
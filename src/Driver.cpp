@@ -0,0 +1,3244 @@
+#include "Driver.h"
+#include "ASTParser.h"
+#include "Common.h"
+#include "LibraryInterface.h"
+#include "ModuleCache.h"
+#include "Object.h"
+#include "PassManager.h"
+#include "Symbols.h"
+#include "TimeReport.h"
+#include "Trace.h"
+#include "VM.h"
+#include "Type.h"
+
+#include <lk/Logger.h>
+
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <sys/wait.h>
+
+template<typename Base, typename T>
+inline bool is_instance_of(const std::shared_ptr<T>&) {
+    return std::is_base_of<Base, T>::value;
+}
+
+static bool is_side_effect_free(const std::shared_ptr<AST::Expression>& expr);
+static bool is_str_builtin(const std::string& name);
+static const AST::Assignment* get_single_assignment(const std::shared_ptr<AST::Body>& body);
+static bool is_numeric_literal(const std::shared_ptr<AST::Expression>& expr, size_t value);
+// function name -> most arguments it's called with
+static void collect_calls(const std::shared_ptr<AST::Body>& body, std::unordered_map<std::string, size_t>& calls);
+static void remove_jumps_to_next_instruction(std::vector<std::string>& text);
+static void remove_unreferenced_strings(const std::vector<std::string>& text, std::vector<std::string>& strings);
+
+static PassManager s_passes;
+static LibraryInterface s_stdlib;
+static ModuleCache s_module_cache;
+static std::mutex s_watched_files_mutex;
+static std::set<std::string> s_watched_files;
+
+std::string stdlib_file(const std::string& dir, const std::string& extension) {
+    return (std::filesystem::path(dir) / ("libxcstd-" + std::string(s_stdlib_version) + extension)).string();
+}
+
+bool write_if_changed(const std::string& path, const std::string& contents, bool& out_changed) {
+    out_changed = false;
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            std::string existing((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (existing == contents) {
+                return true;
+            }
+        }
+    }
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+    if (!file) {
+        lk::log::error() << "failed to write \"" << path << "\"" << std::endl;
+        return false;
+    }
+    out_changed = true;
+    return true;
+}
+
+bool is_up_to_date(const std::string& output, const std::vector<std::string>& inputs) {
+    std::error_code ec;
+    auto output_time = std::filesystem::last_write_time(output, ec);
+    if (ec) {
+        return false;
+    }
+    for (const auto& input : inputs) {
+        auto input_time = std::filesystem::last_write_time(input, ec);
+        if (ec || input_time > output_time) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// adds the files `%include`d by `asm_source` to `out`, and the files those
+// include. Paths are relative to the working directory, like nasm's -I.
+static void collect_asm_includes(const std::string& asm_source, std::set<std::string>& out) {
+    std::istringstream lines(asm_source);
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "%include") != 0) {
+            continue;
+        }
+        auto open = line.find('"', start);
+        auto close = line.find('"', open + 1);
+        if (open == std::string::npos || close == std::string::npos) {
+            continue;
+        }
+        auto path = line.substr(open + 1, close - open - 1);
+        if (out.contains(path)) {
+            continue;
+        }
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            // nasm will complain about it
+            continue;
+        }
+        out.insert(path);
+        collect_asm_includes(std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()), out);
+    }
+}
+
+int run_command(const std::string& command) {
+    XC_INFO("running: " << command << std::endl);
+    int status = WEXITSTATUS(std::system(command.c_str()));
+    XC_TRACE(CommandRun, Trace::string(command), status);
+    return status;
+}
+
+// NASM accepts the `merge` and `strings` section attributes since 2.15, and
+// older versions get string literals in plain .rodata instead
+static bool nasm_supports_merge_sections() {
+    static const bool s_supported = [] {
+        FILE* pipe = ::popen("nasm -v 2>/dev/null", "r");
+        if (!pipe) {
+            return false;
+        }
+        int major = 0;
+        int minor = 0;
+        bool parsed = std::fscanf(pipe, "NASM version %d.%d", &major, &minor) == 2;
+        ::pclose(pipe);
+        if (!parsed || major < 2 || (major == 2 && minor < 15)) {
+            XC_INFO("nasm is missing or older than 2.15, not merging string literals" << std::endl);
+            return false;
+        }
+        return true;
+    }();
+    return s_supported;
+}
+
+static void register_passes(PassManager& passes) {
+    passes.add({
+        .name = "call-graph",
+        .description = "compile callees before their callers",
+        .kind = Pass::Kind::Analysis,
+    });
+    passes.add({
+        .name = "register-variables",
+        .description = "keep variables in registers no call clobbers",
+        .dependencies = { "call-graph" },
+    });
+    passes.add({
+        .name = "frame-elision",
+        .description = "don't set up a frame in leaf functions",
+    });
+    passes.add({
+        .name = "compile-time-evaluation",
+        .description = "replace calls of pure functions with constant arguments by their result",
+    });
+    passes.add({
+        .name = "value-numbering",
+        .description = "reuse values of repeated pure expressions",
+        .level = 2,
+    });
+    passes.add({
+        .name = "branchless-if",
+        .description = "lower simple if/else assignments to cmov/setcc",
+        .level = 2,
+    });
+    passes.add({
+        .name = "bit-tests",
+        .description = "lower small match statements to bit tests",
+    });
+    passes.add({
+        .name = "jump-tables",
+        .description = "lower dense match statements to jump tables",
+        .level = 2,
+        .for_size = false,
+    });
+    passes.add({
+        .name = "peephole",
+        .description = "remove jumps to the next instruction",
+    });
+}
+
+PassManager& compiler_passes() {
+    static bool s_registered = [] {
+        register_passes(s_passes);
+        return true;
+    }();
+    (void)s_registered;
+    return s_passes;
+}
+
+LibraryInterface& standard_library() {
+    return s_stdlib;
+}
+
+ModuleCache& module_cache() {
+    return s_module_cache;
+}
+
+std::set<std::string> take_watched_files() {
+    std::lock_guard lock(s_watched_files_mutex);
+    return std::exchange(s_watched_files, {});
+}
+
+// tables indexed by symbol id take 4 bytes per symbol, for each thread
+static constexpr SymbolId s_max_symbols = 1024 * 1024;
+
+void reset_symbols_if_grown() {
+    if (Symbols::count() <= s_max_symbols) {
+        return;
+    }
+    XC_INFO("dropping the module cache, which holds " << Symbols::count() << " identifiers" << std::endl);
+    s_module_cache.clear();
+    Symbols::reset();
+}
+
+static std::vector<Token> tokenize(std::string_view source, size_t first_line = 1);
+static std::shared_ptr<AST::Unit> parse_in_parallel(std::string_view source, size_t jobs, size_t& error_count);
+static std::shared_ptr<AST::Unit> parse_segments(std::string_view source, const std::vector<ModuleCache::Segment>& previous, size_t jobs, std::vector<ModuleCache::Segment>& out_segments, size_t& error_count);
+static std::shared_ptr<AST::Unit> check_syntax(const std::shared_ptr<AST::Unit>& tree, size_t error_count, const Options& options);
+static std::shared_ptr<AST::Unit> parse_source_text(std::string_view source, const Options& options);
+
+void add_objs_from_obj(const Object& obj, std::unordered_set<std::string>& objs) {
+    // those come from the archive
+    if (obj.is_prebuilt()) {
+        return;
+    }
+    objs.insert(obj.obj_file());
+    for (const auto& dependency : obj.dependencies()) {
+        add_objs_from_obj(*dependency, objs);
+    }
+}
+
+void add_inputs_from_obj(const Object& obj, std::set<std::string>& inputs, const Options& options) {
+    if (obj.is_prebuilt()) {
+        inputs.insert(stdlib_file(options.stdlib, ".a"));
+        inputs.insert(stdlib_file(options.stdlib, ".xci"));
+        return;
+    }
+    inputs.insert(obj.source_file());
+    inputs.insert(obj.asm_includes().begin(), obj.asm_includes().end());
+    for (const auto& dep : obj.dependencies()) {
+        add_inputs_from_obj(*dep, inputs, options);
+    }
+}
+
+// `path` and, if it compiled, everything the object was built from
+static void add_watched_files(const std::string& path, const Object* object, const Options& options) {
+    if (!options.watch) {
+        return;
+    }
+    std::set<std::string> inputs { path };
+    if (object) {
+        add_inputs_from_obj(*object, inputs, options);
+    }
+    std::lock_guard lock(s_watched_files_mutex);
+    s_watched_files.insert(inputs.begin(), inputs.end());
+}
+
+// Everything besides the sources that changes what a module compiles to, so
+// that a compile server only reuses modules built the same way. Objects refer
+// to their files relative to the working directory, so that's part of it too.
+static std::string module_cache_key(const std::string& path, bool standalone, const Options& options) {
+    std::error_code ec;
+    std::string key = std::filesystem::current_path(ec).string();
+    key += '\0' + path + '\0' + options.stdlib + '\0';
+    key += standalone ? 's' : '-';
+    key += options.omit_frame_pointer ? 'f' : '-';
+    key += options.whole_program ? 'w' : '-';
+    key += options.debug ? 'g' : '-';
+    key += options.run ? 'r' : '-';
+    key += std::to_string(options.evaluation_limit) + '\0';
+    for (const auto& pass : s_passes.passes()) {
+        key += s_passes.is_enabled(pass.name) ? '+' : '-';
+    }
+    return key;
+}
+
+std::vector<Token> tokenize_source(std::string_view source) {
+    return tokenize(source);
+}
+
+bool compile_to_asm(const std::shared_ptr<AST::Unit>& unit, const std::string& path, const Options& options, std::string& out_asm) {
+    if (!compiler_passes().resolve()) {
+        return false;
+    }
+    Options asm_options = options;
+    // keeps nasm and ld out of it
+    asm_options.run = true;
+    Object object(unit, asm_options);
+    if (!object.compile(path, true)) {
+        return false;
+    }
+    out_asm = object.asm_source();
+    return true;
+}
+
+std::shared_ptr<AST::Unit> parse_source(const std::string& path, const Options& options) {
+    ModuleCache::Stamp stamp;
+    bool is_cacheable = s_module_cache.is_enabled() && ModuleCache::stamp(path, stamp);
+    if (is_cacheable) {
+        if (auto unit = s_module_cache.find_unit(path, stamp)) {
+            XC_INFO("\"" << path << "\" is unchanged, reusing its parse" << std::endl);
+            return unit;
+        }
+    }
+
+    std::string source;
+    {
+        ScopedPhase phase("load");
+        FILE* file = std::fopen(path.data(), "r");
+        if (!file) {
+            lk::log::error() << "failed to open \"" << path << "\": " << std::strerror(errno) << "\n";
+            return nullptr;
+        }
+        source.resize(std::filesystem::file_size(path));
+        std::fread(source.data(), 1, source.size(), file);
+        std::fclose(file);
+    }
+
+    XC_INFO("loaded source of size " << source.size() << " bytes.\n");
+    XC_TRACE(ModuleLoaded, Trace::string(path), source.size());
+    if (!is_cacheable) {
+        return parse_source_text(source, options);
+    }
+    // only the declarations that changed since the last parse are parsed
+    std::vector<ModuleCache::Segment> segments;
+    size_t error_count = 0;
+    auto tree = parse_segments(source, s_module_cache.find_segments(path), options.jobs, segments, error_count);
+    tree = check_syntax(tree, error_count, options);
+    if (tree) {
+        s_module_cache.add_unit(path, stamp, tree, std::move(segments));
+    }
+    return tree;
+}
+
+static std::shared_ptr<AST::Unit> parse_source_text(std::string_view source, const Options& options) {
+    size_t error_count = 0;
+    auto tree = parse_in_parallel(source, options.jobs, error_count);
+    return check_syntax(tree, error_count, options);
+}
+
+static std::shared_ptr<AST::Unit> check_syntax(const std::shared_ptr<AST::Unit>& tree, size_t error_count, const Options& options) {
+    if (options.debug) {
+        XC_DEBUG("\n"
+            << tree->to_string(1) << std::endl);
+    }
+    XC_INFO("syntax parser had " << error_count << " errors." << std::endl);
+    if (error_count > 0) {
+        return nullptr;
+    }
+    return tree;
+}
+
+std::shared_ptr<Object> compile_source_to_obj(const std::string& path, bool standalone, const Options& options) {
+    ScopedPhase phase("module " + path);
+    std::string cache_key;
+    std::unique_lock<std::mutex> module_lock;
+    if (s_module_cache.is_enabled()) {
+        module_lock = s_module_cache.lock_module(path);
+        cache_key = module_cache_key(path, standalone, options);
+        if (auto object = s_module_cache.find_object(cache_key)) {
+            XC_INFO("\"" << path << "\" and its dependencies are unchanged, reusing its object" << std::endl);
+            add_watched_files(path, object.get(), options);
+            return object;
+        }
+    }
+    auto tree = parse_source(path, options);
+    if (!tree) {
+        add_watched_files(path, nullptr, options);
+        return nullptr;
+    }
+
+    auto object = std::make_shared<Object>(tree, options);
+    if (s_module_cache.is_enabled()) {
+        object->reuse_functions_from(s_module_cache.find_previous_object(cache_key));
+    }
+    if (!object->compile(path, standalone)) {
+        lk::log::error() << "failed to compile \"" << path << "\"" << std::endl;
+        add_watched_files(path, nullptr, options);
+        return nullptr;
+    }
+    add_watched_files(path, object.get(), options);
+    if (s_module_cache.is_enabled()) {
+        // the object files are inputs too, the link needs them
+        std::set<std::string> inputs;
+        add_inputs_from_obj(*object, inputs, options);
+        if (!options.run) {
+            std::unordered_set<std::string> objs;
+            add_objs_from_obj(*object, objs);
+            inputs.insert(objs.begin(), objs.end());
+        }
+        s_module_cache.add_object(cache_key, object, std::vector<std::string>(inputs.begin(), inputs.end()));
+    }
+    return object;
+}
+
+static std::vector<Token> tokenize(std::string_view source, size_t first_line) {
+    std::vector<Token> tokens;
+    size_t line = first_line;
+    // interning takes a lock, most identifiers repeat within a chunk though
+    std::unordered_map<std::string_view, SymbolId> symbols;
+    for (auto iter = source.begin(); iter != source.end() && *iter; ++iter) {
+        Token tok;
+        tok.line = line;
+        if (*iter == ' ' || *iter == '\t') {
+            continue;
+        } else if (*iter == '\n') {
+            ++line;
+            continue;
+        } else if (*iter == '-') {
+            if ((iter + 1) < source.end() && *(iter + 1) == '>') {
+                tok.type = Token::Type::ArrowOperator;
+                ++iter;
+            } else {
+                tok.type = Token::Type::MinusOperator;
+                tok.value = *iter;
+            }
+        } else if (std::isalpha(*iter) || *iter == '_') { // identifer
+            auto end = std::find_if_not(iter, source.end(), [](char c) { return std::isalnum(c) || c == '_'; });
+            auto str = std::string(iter, end);
+            if (str == "fn") {
+                tok.type = Token::Type::FnKeyword;
+            } else if (str == "pure") {
+                tok.type = Token::Type::PureKeyword;
+            } else if (str == "use") {
+                tok.type = Token::Type::UseKeyword;
+            } else if (str == "if") {
+                tok.type = Token::Type::IfKeyword;
+            } else if (str == "else") {
+                tok.type = Token::Type::ElseKeyword;
+            } else if (str == "match") {
+                tok.type = Token::Type::MatchKeyword;
+            } else if (std::find(typenames.begin(), typenames.end(), str) != typenames.end()) {
+                tok.type = Token::Type::Typename;
+                tok.value = str;
+            } else {
+                tok.type = Token::Type::Identifier;
+                tok.value = str;
+                auto view = source.substr(iter - source.begin(), end - iter);
+                auto symbol = symbols.find(view);
+                if (symbol == symbols.end()) {
+                    symbol = symbols.emplace(view, Symbols::intern(view)).first;
+                }
+                tok.symbol = symbol->second;
+            }
+            iter = end - 1;
+        } else if (*iter == '(') {
+            tok.type = Token::Type::OpeningParentheses;
+        } else if (*iter == ')') {
+            tok.type = Token::Type::ClosingParentheses;
+        } else if (*iter == '{') {
+            tok.type = Token::Type::OpeningBrace;
+        } else if (*iter == '}') {
+            tok.type = Token::Type::ClosingBrace;
+        } else if (*iter == '=') {
+            tok.type = Token::Type::Equals;
+        } else if (*iter == '+') {
+            tok.type = Token::Type::PlusOperator;
+            tok.value = *iter;
+        } else if (*iter == '*') {
+            tok.type = Token::Type::MultiplyOperator;
+            tok.value = *iter;
+        } else if (*iter == '/') {
+            tok.type = Token::Type::DivideOperator;
+            tok.value = *iter;
+        } else if (std::isdigit(*iter)) { // numeric literal
+            auto end = std::find_if_not(iter, source.end(), [](char c) { return std::isdigit(c); });
+            auto str = std::string(iter, end);
+            size_t value {};
+            std::from_chars(&*iter, &*iter + (end - iter), value);
+            tok.type = Token::Type::NumericLiteral;
+            tok.value = value;
+            iter = end - 1;
+        } else if (*iter == ',') {
+            tok.type = Token::Type::Comma;
+        } else if (*iter == ';') {
+            tok.type = Token::Type::Semicolon;
+        } else if (*iter == '"') {
+            auto end = std::find_if(iter + 1, source.end(), [](char c) { return c == '"'; });
+            if (end == source.end()) {
+                XC_WARNING(line << ": end of file before end of string literal!\n");
+                continue;
+            }
+            tok.type = Token::Type::StringLiteral;
+            tok.value = std::string(iter + 1, end);
+            line += std::count(iter, end, '\n');
+            iter = end;
+        } else {
+            lk::log::error() << line << ": couldn't parse: " << std::string(&*iter) << "\n";
+            continue;
+        }
+        tokens.push_back(std::move(tok));
+    }
+    return tokens;
+}
+
+// where top-level declarations start, and on which line
+struct TopLevelBoundary {
+    size_t offset;
+    size_t line;
+};
+
+// finds the `fn`, `pure fn` and `use` declarations outside of any braces,
+// without tokenizing
+static std::vector<TopLevelBoundary> find_top_level_boundaries(std::string_view source) {
+    std::vector<TopLevelBoundary> boundaries;
+    size_t depth = 0;
+    size_t line = 1;
+    bool after_pure = false;
+    for (size_t i = 0; i < source.size() && source[i]; ++i) {
+        char c = source[i];
+        if (c == '\n') {
+            ++line;
+        } else if (c == '"') {
+            auto end = source.find('"', i + 1);
+            if (end == std::string_view::npos) {
+                // the tokenizer complains about this, the rest stays one chunk
+                break;
+            }
+            line += std::count(source.begin() + i, source.begin() + end, '\n');
+            i = end;
+        } else if (c == '{') {
+            ++depth;
+        } else if (c == '}') {
+            depth -= depth > 0 ? 1 : 0;
+        } else if (std::isalpha(c) || c == '_') {
+            size_t end = i;
+            while (end < source.size() && (std::isalnum(source[end]) || source[end] == '_')) {
+                ++end;
+            }
+            auto word = source.substr(i, end - i);
+            bool is_start = depth == 0 && (word == "use" || word == "pure" || (word == "fn" && !after_pure));
+            if (is_start) {
+                boundaries.push_back({ i, line });
+            }
+            after_pure = depth == 0 && word == "pure";
+            i = end - 1;
+        } else if (std::isdigit(c)) {
+            // so the digits of `x1` aren't the start of a word
+            while (i + 1 < source.size() && std::isalnum(source[i + 1])) {
+                ++i;
+            }
+        }
+    }
+    return boundaries;
+}
+
+// below this, a unit isn't worth splitting up
+static constexpr size_t s_min_parallel_chunk_size = 64 * 1024;
+
+// Parses each top-level declaration of `source` on its own. Those whose text
+// is the same as that of a segment in `previous` aren't tokenized or parsed
+// again. The AST has no line numbers, so that's right even if they moved. The
+// others are tokenized from the line they start on, so that errors point to
+// the right line.
+static std::shared_ptr<AST::Unit> parse_segments(std::string_view source, const std::vector<ModuleCache::Segment>& previous, size_t jobs, std::vector<ModuleCache::Segment>& out_segments, size_t& error_count) {
+    std::vector<TopLevelBoundary> starts { { 0, 1 } };
+    for (const auto& boundary : find_top_level_boundaries(source)) {
+        if (boundary.offset > 0) {
+            starts.push_back(boundary);
+        }
+    }
+    auto segment_text = [&](size_t i) {
+        size_t end = i + 1 < starts.size() ? starts.at(i + 1).offset : source.size();
+        return source.substr(starts.at(i).offset, end - starts.at(i).offset);
+    };
+    // a declaration written twice reuses two segments. The fingerprint only
+    // finds candidates, their text has to be the same too.
+    std::unordered_multimap<uint64_t, const ModuleCache::Segment*> reusable;
+    for (const auto& segment : previous) {
+        reusable.emplace(segment.fingerprint, &segment);
+    }
+    out_segments.assign(starts.size(), {});
+    std::vector<size_t> changed;
+    size_t changed_size = 0;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        auto text = segment_text(i);
+        out_segments.at(i).fingerprint = std::hash<std::string_view> {}(text);
+        out_segments.at(i).text = text;
+        auto [begin, end] = reusable.equal_range(out_segments.at(i).fingerprint);
+        auto iter = std::find_if(begin, end, [&](const auto& entry) { return entry.second->text == text; });
+        if (iter != end) {
+            out_segments.at(i).unit = iter->second->unit;
+            reusable.erase(iter);
+        } else {
+            changed.push_back(i);
+            changed_size += text.size();
+        }
+    }
+
+    std::atomic<size_t> next_changed { 0 };
+    std::atomic<size_t> token_count { 0 };
+    std::atomic<size_t> errors { 0 };
+    auto phase_path = TimeReport::current_path();
+    auto work = [&] {
+        ScopedPhase::Adopt adopt(phase_path);
+        for (size_t k = next_changed++; k < changed.size(); k = next_changed++) {
+            size_t i = changed.at(k);
+            std::vector<Token> tokens;
+            {
+                ScopedPhase phase("tokenize");
+                tokens = tokenize(segment_text(i), starts.at(i).line);
+            }
+            ScopedPhase phase("parse");
+            AST::Parser parser(tokens);
+            out_segments.at(i).unit = parser.unit();
+            token_count += tokens.size();
+            errors += parser.error_count();
+        }
+    };
+    // this thread works too
+    std::vector<std::thread> threads(std::min(jobs, std::max<size_t>(1, changed_size / s_min_parallel_chunk_size)) - 1);
+    for (auto& thread : threads) {
+        thread = std::thread(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto unit = std::make_shared<AST::Unit>();
+    for (const auto& segment : out_segments) {
+        unit->use_decls.insert(unit->use_decls.end(), segment.unit->use_decls.begin(), segment.unit->use_decls.end());
+        unit->decls.insert(unit->decls.end(), segment.unit->decls.begin(), segment.unit->decls.end());
+    }
+    error_count += errors;
+    XC_INFO("parsed " << token_count << " tokens in " << changed.size() << " of " << starts.size() << " top-level declarations.\n");
+    XC_TRACE(UnitParsed, token_count.load(), changed.size());
+    return unit;
+}
+
+// tokenizes and parses chunks of the source that start at top-level
+// declarations on multiple threads, and stitches the results together
+static std::shared_ptr<AST::Unit> parse_in_parallel(std::string_view source, size_t jobs, size_t& error_count) {
+    std::vector<TopLevelBoundary> chunks { { 0, 1 } };
+    size_t chunk_count = std::min(jobs, source.size() / s_min_parallel_chunk_size);
+    if (chunk_count > 1) {
+        for (const auto& boundary : find_top_level_boundaries(source)) {
+            if (boundary.offset >= chunks.size() * source.size() / chunk_count) {
+                chunks.push_back(boundary);
+            }
+        }
+    }
+    struct ChunkResult {
+        std::shared_ptr<AST::Unit> unit;
+        size_t token_count { 0 };
+        size_t error_count { 0 };
+    };
+    std::vector<ChunkResult> results(chunks.size());
+    auto phase_path = TimeReport::current_path();
+    auto parse_chunk = [&](size_t i) {
+        ScopedPhase::Adopt adopt(phase_path);
+        size_t end = i + 1 < chunks.size() ? chunks.at(i + 1).offset : source.size();
+        std::vector<Token> tokens;
+        {
+            ScopedPhase phase("tokenize");
+            tokens = tokenize(source.substr(chunks.at(i).offset, end - chunks.at(i).offset), chunks.at(i).line);
+        }
+        ScopedPhase phase("parse");
+        AST::Parser parser(tokens);
+        results.at(i) = { parser.unit(), tokens.size(), parser.error_count() };
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        threads.emplace_back(parse_chunk, i);
+    }
+    parse_chunk(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto unit = std::make_shared<AST::Unit>();
+    size_t token_count = 0;
+    for (const auto& result : results) {
+        unit->use_decls.insert(unit->use_decls.end(), result.unit->use_decls.begin(), result.unit->use_decls.end());
+        unit->decls.insert(unit->decls.end(), result.unit->decls.begin(), result.unit->decls.end());
+        token_count += result.token_count;
+        error_count += result.error_count;
+    }
+    XC_INFO("counted " << std::count(source.begin(), source.end(), '\n') << " lines.\n");
+    XC_INFO("parsed " << token_count << " tokens in " << chunks.size() << " chunks.\n");
+    XC_TRACE(UnitParsed, token_count, chunks.size());
+    return unit;
+}
+
+Object::Object(const std::shared_ptr<AST::Unit>& root, const Options& options)
+    : m_options(options)
+    , m_root(root) {
+    m_types.insert(s_builtin_types.begin(), s_builtin_types.end());
+    m_types.insert(s_str_type);
+}
+
+Object::Object(Object& module, const std::string& function_name)
+    : m_options(module.m_options)
+    , m_root(module.m_root)
+    , m_module(&module)
+    , m_label_prefix(function_name + "_") {
+    m_types.insert(s_builtin_types.begin(), s_builtin_types.end());
+    m_types.insert(s_str_type);
+}
+
+Object::Object(const LibraryInterface::Module& module, const LibraryInterface& library, const std::string& archive, const Options& options)
+    : m_options(options)
+    , m_prebuilt(true)
+    , m_prebuilt_source(module.source) {
+    m_types.insert(s_builtin_types.begin(), s_builtin_types.end());
+    m_types.insert(s_str_type);
+    m_source_file = module.path + ".xc";
+    m_obj_file = archive + "(" + module.path + ")";
+    m_globals = module.globals;
+    m_pure_globals = module.pure_functions;
+    m_pure_functions.insert(module.pure_functions.begin(), module.pure_functions.end());
+    m_clobber_sets.insert(module.clobber_sets.begin(), module.clobber_sets.end());
+    for (const auto& use : module.uses) {
+        if (auto dependency = library.find(use)) {
+            m_dependencies.emplace_back(std::make_shared<Object>(*dependency, library, archive, m_options));
+        }
+    }
+}
+
+constexpr const char* libasm_decl = R"(
+; all globals, asm decls
+%include "asm/extern.asm"
+)";
+
+constexpr const char* libasm = R"(
+; libasm
+%include "asm/lib.asm"
+)";
+
+bool build_stdlib(const std::string& dir, const Options& options) {
+    ScopedPhase phase("build stdlib");
+    std::error_code ec;
+    auto objects_dir = std::filesystem::path(dir) / "objects";
+    std::filesystem::create_directories(objects_dir, ec);
+    if (ec) {
+        lk::log::error() << "failed to create \"" << objects_dir.string() << "\": " << ec.message() << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> sources;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator("std", ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".xc") {
+            sources.push_back(entry.path().generic_string());
+        }
+    }
+    if (ec) {
+        lk::log::error() << "failed to list the standard library: " << ec.message() << std::endl;
+        return false;
+    }
+    // so the archive and interface don't depend on directory order
+    std::sort(sources.begin(), sources.end());
+
+    LibraryInterface library;
+    library.version = s_stdlib_version;
+    std::string archive = stdlib_file(dir, ".a");
+    std::string archive_command = "ar rcs " + archive;
+    for (const auto& source : sources) {
+        auto obj = compile_source_to_obj(source, false, options);
+        if (!obj) {
+            return false;
+        }
+        auto& module = library.modules.emplace_back();
+        module.path = (std::filesystem::path(source).parent_path() / std::filesystem::path(source).stem()).generic_string();
+        for (const auto& use_decl : obj->unit()->use_decls) {
+            module.uses.push_back(use_decl->path);
+        }
+        module.globals = obj->globals();
+        module.pure_functions = obj->pure_functions();
+        for (const auto& global : obj->globals()) {
+            if (auto clobbers = obj->clobber_set(global)) {
+                module.clobber_sets[global] = *clobbers;
+            }
+        }
+        std::ifstream file(source, std::ios::binary);
+        module.source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        // members are named after the module, since ar only keeps file names
+        std::string member = module.path;
+        std::replace(member.begin(), member.end(), '/', '_');
+        auto member_path = objects_dir / (member + ".o");
+        std::filesystem::copy_file(obj->obj_file(), member_path, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            lk::log::error() << "failed to copy \"" << obj->obj_file() << "\": " << ec.message() << std::endl;
+            return false;
+        }
+        archive_command += " " + member_path.string();
+    }
+
+    // the asm library, which standalone units otherwise include
+    auto asm_lib = (objects_dir / "asm_lib").string();
+    {
+        std::ofstream file(asm_lib + ".asm");
+        file << "section .text\n"
+             << libasm;
+        if (!file) {
+            lk::log::error() << "failed to write \"" << asm_lib << ".asm\"" << std::endl;
+            return false;
+        }
+    }
+    std::string assemble_command = "nasm " + asm_lib + ".asm -o " + asm_lib + ".o -Wall -felf64 -I.";
+    if (run_command(assemble_command) != 0) {
+        lk::log::error() << "nasm failed\n";
+        return false;
+    }
+    archive_command += " " + asm_lib + ".o";
+
+    // ar adds to an existing archive, so members of removed modules would stay
+    std::filesystem::remove(archive, ec);
+    if (run_command(archive_command) != 0) {
+        lk::log::error() << "ar failed\n";
+        return false;
+    }
+    if (!library.write(stdlib_file(dir, ".xci"))) {
+        return false;
+    }
+    XC_INFO("built standard library with " << library.modules.size() << " modules into \"" << archive << "\"" << std::endl);
+    return true;
+}
+
+constexpr const char* custom_start = R"(
+; core language _start
+%include "asm/_start.asm"
+)";
+
+bool Object::compile(const std::string& original_filename, bool standalone) {
+    assert(m_root);
+
+    bool ok = compile_unit(m_root);
+    if (!ok) {
+        lk::log::error() << "compilation failed.\n";
+        return false;
+    }
+
+    auto stem = std::filesystem::path(original_filename).parent_path() / std::filesystem::path(original_filename).stem();
+
+    m_source_file = original_filename;
+    { // ostringstream scope
+        ScopedPhase phase("emit asm");
+        std::ostringstream outfile;
+        if (standalone) {
+            outfile << "global _start\n";
+        }
+        outfile << "\nsection .data\n";
+
+        // write all known globals of dependencies
+        for (const auto& dep : dependencies()) {
+            outfile << "\t; externs from dependency \"" << dep->obj_file() << "\"\n";
+            for (const auto& global : dep->globals()) {
+                outfile << "\textern " << global << "\n";
+            }
+        }
+
+        // write own globals
+        outfile << "\t; own globals\n";
+        for (const auto& global : globals()) {
+            outfile << "\tglobal " << global << "\n";
+        }
+
+        outfile << "\t; own data\n";
+        for (const auto& line : m_asm_data) {
+            outfile << line << "\n";
+        }
+
+        if (!m_asm_rodata.empty()) {
+            outfile << "\nsection .rodata\n";
+            for (const auto& line : m_asm_rodata) {
+                outfile << line << "\n";
+            }
+        }
+
+        // NUL-terminated strings in a mergeable section, so the linker keeps
+        // one copy of each string across modules, and folds strings that end
+        // another one into it. The in-process assembler ignores the
+        // attributes, so only nasm has to support them.
+        if (!m_asm_strings.empty()) {
+            if (m_options.run || nasm_supports_merge_sections()) {
+                outfile << "\nsection .rodata.str1.1 progbits alloc noexec nowrite merge strings byte align=1\n";
+            } else {
+                outfile << "\nsection .rodata\n";
+            }
+            for (const auto& line : m_asm_strings) {
+                outfile << tab() << line << "\n";
+            }
+        }
+
+        outfile << "\nsection .text\n";
+        // the prebuilt standard library brings its own copy
+        if (standalone && m_options.stdlib.empty()) {
+            outfile << libasm;
+        } else {
+            outfile << libasm_decl;
+        }
+
+        // TODO syscall missing one argument
+        for (const auto& line : m_asm_text) {
+            outfile << line << "\n";
+        }
+        if (standalone) {
+            outfile << custom_start << "\n";
+        }
+        m_asm_source = outfile.str();
+    }
+
+    if (m_options.run) {
+        return true;
+    }
+
+    auto outfile_name = stem.string() + ".asm";
+    bool asm_changed = false;
+    {
+        ScopedPhase phase("write asm");
+        if (!write_if_changed(outfile_name, m_asm_source, asm_changed)) {
+            return false;
+        }
+    }
+
+    m_obj_file = stem.string() + ".o";
+    collect_asm_includes(m_asm_source, m_asm_includes);
+    std::vector<std::string> asm_inputs { outfile_name };
+    asm_inputs.insert(asm_inputs.end(), m_asm_includes.begin(), m_asm_includes.end());
+    if (!asm_changed && is_up_to_date(m_obj_file, asm_inputs)) {
+        XC_INFO("\"" << m_obj_file << "\" is up to date" << std::endl);
+        return true;
+    }
+    std::string compile_cmd = "nasm " + stem.string() + ".asm -o " + m_obj_file + " -Wall -felf64 -I.";
+    if (m_options.debug) {
+        compile_cmd += " -g";
+    }
+    ScopedPhase phase("nasm");
+    if (run_command(compile_cmd) != 0) {
+        lk::log::error() << "nasm failed\n";
+        return false;
+    }
+
+    XC_INFO("successfully compiled \"" << original_filename << "\" to \"" << m_obj_file << "\"" << std::endl);
+    return true;
+}
+
+bool Object::get_location_for_identifier(const AST::Identifier& id, std::string& out) {
+    auto variable = m_variables.find(id.symbol);
+    if (!variable) {
+        error("'" + id.name + "' is not declared");
+        return false;
+    }
+    out = variable->location;
+    return true;
+}
+
+std::string Object::generate_signature(const std::shared_ptr<AST::FunctionDecl>& func) {
+    std::string res = (func->is_pure ? "pure fn " : "fn ") + func->name->name;
+    res += "(";
+    if (func->arguments) {
+        for (const auto& arg : func->arguments->variables) {
+            res += arg->type_name->name + " " + arg->identifier->name;
+            if (arg != func->arguments->variables.back()) {
+                res += ",";
+            }
+        }
+    }
+    res += ")";
+    if (func->result) {
+        res += "->" + func->result->type_name->name + " " + func->result->identifier->name;
+    }
+    return res;
+}
+
+bool Object::register_identifier(const AST::Identifier& id, Type type, std::string& out_location, const std::string& fixed_location, const std::string& fixed_length_location) {
+    XC_DEBUG("identifier '" << id.name << "' is type: " << type << std::endl);
+    XC_TRACE(IdentifierDeclared, Trace::string(id.name), type.size);
+    // the pointer and the length of a str are placed like two u64 variables
+    Type part_type = type;
+    if (type.name == s_str_type.name && !get_type_by_name(part_type, "u64")) {
+        return false;
+    }
+    auto location = fixed_location.empty() ? allocate_variable_location(part_type) : fixed_location;
+    std::string length_location;
+    if (type.name == s_str_type.name) {
+        length_location = fixed_length_location.empty() ? allocate_variable_location(part_type) : fixed_length_location;
+    }
+    if (!m_variables.declare(id.symbol, Variable { type, location, length_location })) {
+        error("'" + id.name + "' is already declared in this scope");
+        return false;
+    }
+    out_location = location;
+    return true;
+}
+
+bool Object::is_str_variable(const AST::Identifier& id) const {
+    auto variable = m_variables.find(id.symbol);
+    return variable && variable->type.name == s_str_type.name;
+}
+
+bool Object::is_str_argument(const std::string& function_name, size_t index) const {
+    const auto& decls = module().m_function_decls;
+    auto iter = decls.find(function_name);
+    if (iter == decls.end() || !iter->second->arguments || index >= iter->second->arguments->variables.size()) {
+        return false;
+    }
+    return iter->second->arguments->variables.at(index)->type_name->name == s_str_type.name;
+}
+
+// a str argument is passed in two slots, its pointer and then its length
+size_t Object::argument_slot_count(const std::string& function_name, size_t argument_count) const {
+    size_t slots = 0;
+    for (size_t i = 0; i < argument_count; ++i) {
+        slots += is_str_argument(function_name, i) ? 2 : 1;
+    }
+    return slots;
+}
+
+void Object::enter_scope() {
+    m_variables.enter_scope();
+}
+
+void Object::leave_scope() {
+    // variables shadowed by this scope come back, and must not be mistaken for
+    // the ones that shadowed them
+    m_variables.for_each_in_scope([this](SymbolId symbol, const Variable&) {
+        invalidate_variable(symbol);
+    });
+    m_variables.leave_scope();
+}
+
+std::string Object::allocate_variable_location(const Type& type) {
+    if (type.size <= 8 && !m_variable_registers.empty() && m_available_temporaries.size() > s_reserved_temporaries) {
+        auto reg = m_variable_registers.front();
+        take_variable_register(reg);
+        return reg;
+    }
+    return stack_location(make_stack_ptr_for_size(type.size));
+}
+
+void Object::take_variable_register(const std::string& reg) {
+    std::erase(m_variable_registers, reg);
+    std::erase(m_available_temporaries, reg);
+    m_clobbered_registers.insert(reg);
+}
+
+std::string Object::incoming_argument_location(size_t index) const {
+    // the caller leaves arguments past the argument registers right above the
+    // return address
+    size_t offset = 8 * (index - std::size(m_arg_registers));
+    if (m_omit_frame_pointer) {
+        return "rsp+__frame_size+" + std::to_string(8 + offset);
+    }
+    return "rbp+" + std::to_string(16 + offset);
+}
+
+std::set<std::string> Object::clobbered_by_call(const std::string& function_name) const {
+    if (!s_passes.is_enabled("register-variables")) {
+        return s_caller_saved_registers;
+    }
+    auto builtin = s_builtin_clobbers.find(function_name);
+    if (builtin != s_builtin_clobbers.end()) {
+        return builtin->second;
+    }
+    if (auto own = clobber_set(function_name)) {
+        return *own;
+    }
+    // a dependency may be recompiled on its own, unless the whole program is
+    // compiled together
+    if (m_options.whole_program) {
+        for (const auto& dep : module().dependencies()) {
+            if (auto clobbers = dep->clobber_set(function_name)) {
+                return *clobbers;
+            }
+        }
+    }
+    return s_caller_saved_registers;
+}
+
+const std::set<std::string>* Object::clobber_set(const std::string& function_name) const {
+    auto iter = m_clobber_sets.find(function_name);
+    if (iter == m_clobber_sets.end()) {
+        return nullptr;
+    }
+    return &iter->second;
+}
+
+size_t Object::make_stack_ptr_for_size(size_t size) {
+    return m_current_stack_ptr += size;
+}
+
+std::string Object::stack_location(size_t offset) const {
+    if (m_omit_frame_pointer) {
+        // __frame_size is defined once the size of the frame is known, and is 0
+        // for functions that only use the red zone
+        return "rsp+__frame_size-" + std::to_string(offset);
+    }
+    return "rbp-" + std::to_string(offset);
+}
+
+bool Object::is_stack_location(const std::string& location) {
+    return location.starts_with("rbp") || location.starts_with("rsp");
+}
+
+std::string Object::generate_unique_label() {
+    std::string name = m_obj_file;
+    for (char& c : name) {
+        if (!isalnum(c)) {
+            c = '_';
+        }
+    }
+    return "__" + name + "_" + m_label_prefix + std::to_string(m_unique_label_i++);
+}
+
+const std::vector<std::string>& Object::globals() const {
+    return m_globals;
+}
+
+const std::vector<std::string>& Object::pure_functions() const {
+    return m_pure_globals;
+}
+
+bool Object::get_type_by_name(Type& out_type, const std::string& type_name) const {
+    auto iter = std::find_if(m_types.begin(), m_types.end(), [&type_name](const Type& type) { return type.name == type_name; });
+    if (iter != m_types.end()) {
+        out_type = *iter;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+const std::string& Object::source_file() const {
+    return m_source_file;
+}
+
+const std::shared_ptr<AST::Unit>& Object::unit() const {
+    if (!m_root && m_prebuilt) {
+        m_root = parse_source_text(m_prebuilt_source, m_options);
+        if (!m_root) {
+            // keeps callers from dereferencing nullptr
+            m_root = std::make_shared<AST::Unit>();
+        }
+    }
+    return m_root;
+}
+
+const std::string& Object::asm_source() const {
+    return m_asm_source;
+}
+
+const std::set<std::string>& Object::asm_includes() const {
+    return m_asm_includes;
+}
+
+const std::string& Object::obj_file() const {
+    return m_obj_file;
+}
+
+const std::vector<std::shared_ptr<Object>>& Object::dependencies() const {
+    return m_dependencies;
+}
+
+bool Object::compile_use_decl(const std::shared_ptr<AST::UseDecl>& unit) {
+    if (auto module = s_stdlib.find(unit->path); module && !m_options.stdlib.empty()) {
+        m_dependencies.emplace_back(std::make_shared<Object>(*module, s_stdlib, stdlib_file(m_options.stdlib, ".a"), m_options));
+        return true;
+    }
+    auto ptr = compile_source_to_obj(unit->path + ".xc", false, m_options);
+    if (!ptr) {
+        lk::log::error() << "failed to compile dependency \"" << unit->path << "\"" << std::endl;
+        return false;
+    }
+    m_dependencies.emplace_back(std::move(ptr));
+    return true;
+}
+
+void Object::reuse_functions_from(std::shared_ptr<const Object> previous) {
+    m_keep_functions = true;
+    m_previous = std::move(previous);
+}
+
+// What the code of function `index` of `unit` may depend on in its unit
+// besides the function itself: the argument types of the functions it calls
+// and which of them are pure, and the code of the pure ones, as calls to them
+// may be evaluated at compile time, and so on for the functions those call.
+// Functions it can't reach don't matter, so adding or removing them doesn't
+// compile it again.
+std::string Object::function_context_key(const std::shared_ptr<AST::Unit>& unit, const std::vector<std::vector<size_t>>& callees, size_t index) const {
+    std::string key;
+    std::vector<bool> added(unit->decls.size(), false);
+    std::vector<size_t> pending(callees.at(index).rbegin(), callees.at(index).rend());
+    while (!pending.empty()) {
+        auto i = pending.back();
+        pending.pop_back();
+        if (added.at(i)) {
+            continue;
+        }
+        added.at(i) = true;
+        const auto& decl = unit->decls.at(i);
+        // calls pass str arguments differently
+        key += decl->name->name + "(";
+        if (decl->arguments) {
+            for (const auto& arg : decl->arguments->variables) {
+                key += arg->type_name->name + ",";
+            }
+        }
+        key += ")";
+        if (decl->is_pure) {
+            key += "=" + std::to_string(decl->fingerprint);
+            pending.insert(pending.end(), callees.at(i).rbegin(), callees.at(i).rend());
+        }
+        key += " ";
+    }
+    return key;
+}
+
+// what the code of any function may depend on outside of its unit: what the
+// dependencies export, and how their functions were compiled
+std::string Object::dependencies_key() const {
+    std::string key;
+    std::unordered_set<const Object*> added;
+    std::function<void(const Object&)> add_dependency = [&](const Object& dependency) {
+        if (!added.insert(&dependency).second) {
+            return;
+        }
+        key += "\n" + dependency.source_file() + " ";
+        if (dependency.is_prebuilt()) {
+            key += std::to_string(std::hash<std::string> {}(dependency.m_prebuilt_source));
+        } else {
+            for (const auto& decl : dependency.unit()->decls) {
+                key += std::to_string(decl->fingerprint) + " ";
+            }
+        }
+        std::map<std::string, std::set<std::string>> clobber_sets(dependency.m_clobber_sets.begin(), dependency.m_clobber_sets.end());
+        for (const auto& [name, registers] : clobber_sets) {
+            key += name + ":";
+            for (const auto& reg : registers) {
+                key += reg + ",";
+            }
+            key += " ";
+        }
+        for (const auto& transitive : dependency.dependencies()) {
+            add_dependency(*transitive);
+        }
+    };
+    for (const auto& dependency : dependencies()) {
+        add_dependency(*dependency);
+    }
+    return key;
+}
+
+bool Object::compile_unit(const std::shared_ptr<AST::Unit>& unit) {
+    for (const auto& use_decl : unit->use_decls) {
+        bool ok = compile_use_decl(use_decl);
+        if (!ok) {
+            return false;
+        }
+    }
+    ScopedPhase phase("compile unit");
+    for (const auto& dep : dependencies()) {
+        m_pure_functions.insert(dep->pure_functions().begin(), dep->pure_functions().end());
+        for (const auto& function_decl : dep->unit()->decls) {
+            m_function_decls[function_decl->name->name] = function_decl;
+        }
+    }
+    for (const auto& function_decl : unit->decls) {
+        if (function_decl->is_pure) {
+            m_pure_globals.push_back(function_decl->name->name);
+            m_pure_functions.insert(function_decl->name->name);
+        }
+        m_function_decls[function_decl->name->name] = function_decl;
+    }
+    // callees are compiled before their callers, so that calls know exactly
+    // which registers they clobber. The text still ends up in source order.
+    std::unordered_map<std::string, size_t> decl_indices;
+    for (size_t i = 0; i < unit->decls.size(); ++i) {
+        decl_indices[unit->decls.at(i)->name->name] = i;
+        m_globals.push_back(unit->decls.at(i)->name->name);
+    }
+    std::vector<size_t> order(unit->decls.size());
+    std::iota(order.begin(), order.end(), 0);
+    // in-unit callees of each function, sorted by name so the order doesn't
+    // depend on hashing
+    std::vector<std::vector<size_t>> callees(unit->decls.size());
+    for (size_t i = 0; i < unit->decls.size(); ++i) {
+        std::unordered_map<std::string, size_t> calls;
+        collect_calls(unit->decls.at(i)->body, calls);
+        std::vector<std::string> names;
+        for (const auto& [name, argument_count] : calls) {
+            names.push_back(name);
+        }
+        std::sort(names.begin(), names.end());
+        for (const auto& name : names) {
+            auto iter = decl_indices.find(name);
+            if (iter != decl_indices.end()) {
+                callees.at(i).push_back(iter->second);
+            }
+        }
+    }
+    std::vector<std::string> function_keys(unit->decls.size());
+    if (m_keep_functions) {
+        auto key = dependencies_key();
+        for (size_t i = 0; i < unit->decls.size(); ++i) {
+            function_keys.at(i) = key + "\n" + function_context_key(unit, callees, i);
+        }
+    }
+    std::vector<bool> visited(unit->decls.size(), false);
+    std::function<void(size_t)> visit = [&](size_t i) {
+        if (visited.at(i)) {
+            return;
+        }
+        visited.at(i) = true;
+        for (auto callee : callees.at(i)) {
+            visit(callee);
+        }
+        order.push_back(i);
+    };
+    s_passes.run("call-graph", [&] {
+        order.clear();
+        for (size_t i = 0; i < unit->decls.size(); ++i) {
+            visit(i);
+        }
+        return true;
+    });
+
+    // a function waits only for the callees before it in the order, which are
+    // exactly the ones it would see compiled when going one by one. That way
+    // the code doesn't depend on the number of threads. Callees after it are
+    // part of a cycle, and assumed to clobber everything.
+    std::vector<size_t> position(unit->decls.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        position.at(order.at(k)) = k;
+    }
+    std::vector<std::vector<size_t>> waited_for_by(unit->decls.size());
+    std::vector<size_t> waiting_for(unit->decls.size(), 0);
+    for (size_t i = 0; i < unit->decls.size(); ++i) {
+        std::erase_if(callees.at(i), [&](size_t callee) { return position.at(callee) >= position.at(i); });
+        for (auto callee : callees.at(i)) {
+            waited_for_by.at(callee).push_back(i);
+        }
+        waiting_for.at(i) = callees.at(i).size();
+    }
+    std::deque<size_t> ready;
+    for (auto i : order) {
+        if (waiting_for.at(i) == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    // A function's code depends on its tokens, its name, which its labels are
+    // made from, the clobber sets of the callees it waits for, and what's in
+    // its context key. If all of them are as in the previous compile, so is
+    // the code, wherever the function moved to.
+    size_t reused_count = 0;
+    std::vector<FunctionOutput> outputs(unit->decls.size());
+    std::mutex mutex;
+    std::condition_variable progress;
+    size_t remaining = unit->decls.size();
+    bool failed = false;
+    auto phase_path = TimeReport::current_path();
+    auto work = [&] {
+        ScopedPhase::Adopt adopt(phase_path);
+        // indexed by symbol id, which counts the identifiers of every module,
+        // so each thread keeps one for all the functions it compiles
+        ScopedSymbolTable<Variable> variables;
+        std::unique_lock lock(mutex);
+        for (;;) {
+            progress.wait(lock, [&] { return !ready.empty() || remaining == 0 || failed; });
+            if (ready.empty() || failed) {
+                return;
+            }
+            auto i = ready.front();
+            ready.pop_front();
+            const auto& decl = unit->decls.at(i);
+            Object context(*this, decl->name->name);
+            std::string key;
+            if (m_keep_functions) {
+                key = function_keys.at(i) + "\n" + decl->name->name + " " + std::to_string(decl->fingerprint);
+            }
+            for (auto callee : callees.at(i)) {
+                const auto& name = unit->decls.at(callee)->name->name;
+                context.m_clobber_sets[name] = m_clobber_sets.at(name);
+                if (m_keep_functions) {
+                    key += " " + name + ":";
+                    for (const auto& reg : m_clobber_sets.at(name)) {
+                        key += reg + ",";
+                    }
+                }
+            }
+            const CompiledFunction* previous = nullptr;
+            if (m_previous) {
+                auto iter = m_previous->m_compiled_functions.find(key);
+                previous = iter != m_previous->m_compiled_functions.end() ? &iter->second : nullptr;
+            }
+            lock.unlock();
+            bool ok = true;
+            CompiledFunction compiled;
+            if (previous) {
+                compiled = *previous;
+            } else {
+                context.m_variables = std::move(variables);
+                ok = context.compile_function_decl(decl);
+                variables = std::move(context.m_variables);
+                if (ok) {
+                    s_passes.run("peephole", [&] {
+                        remove_jumps_to_next_instruction(context.m_asm_text);
+                        return true;
+                    });
+                    // literals whose only uses were folded at compile time
+                    remove_unreferenced_strings(context.m_asm_text, context.m_asm_strings);
+                    XC_TRACE(FunctionCompiled, Trace::string(decl->name->name), context.m_asm_text.size());
+                    compiled.output = { std::move(context.m_asm_text), std::move(context.m_asm_data), std::move(context.m_asm_rodata), std::move(context.m_asm_strings) };
+                    compiled.clobber_set = std::move(context.m_clobber_sets.at(decl->name->name));
+                }
+            }
+            lock.lock();
+            if (!ok) {
+                failed = true;
+                progress.notify_all();
+                return;
+            }
+            if (previous) {
+                ++reused_count;
+            }
+            if (m_keep_functions) {
+                m_compiled_functions[key] = compiled;
+            }
+            m_clobber_sets[decl->name->name] = std::move(compiled.clobber_set);
+            outputs.at(i) = std::move(compiled.output);
+            --remaining;
+            for (auto caller : waited_for_by.at(i)) {
+                if (--waiting_for.at(caller) == 0) {
+                    ready.push_back(caller);
+                }
+            }
+            progress.notify_all();
+        }
+    };
+    // this thread works too
+    std::vector<std::thread> threads(std::min(m_options.jobs, unit->decls.size()) - (unit->decls.empty() ? 0 : 1));
+    for (auto& thread : threads) {
+        thread = std::thread(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // the previous compile isn't needed anymore, and shouldn't be kept
+    // alive by this one
+    m_previous.reset();
+    if (failed) {
+        return false;
+    }
+    if (m_keep_functions) {
+        XC_INFO("reused the code of " << reused_count << " of " << unit->decls.size() << " functions" << std::endl);
+    }
+    // merged in source order, so the output is the same for any number of
+    // threads
+    for (auto& output : outputs) {
+        m_asm_text.insert(m_asm_text.end(), output.text.begin(), output.text.end());
+        m_asm_data.insert(m_asm_data.end(), output.data.begin(), output.data.end());
+        m_asm_rodata.insert(m_asm_rodata.end(), output.rodata.begin(), output.rodata.end());
+        m_asm_strings.insert(m_asm_strings.end(), output.strings.begin(), output.strings.end());
+    }
+    return true;
+}
+
+bool Object::compile_function_decl(const std::shared_ptr<AST::FunctionDecl>& decl) {
+    ScopedPhase phase("compile function", decl->name->name);
+    m_current_reg = 0;
+    m_current_stack_ptr = 0;
+    m_outgoing_args_size = 0;
+    m_current_function = decl;
+    m_value_shape_counts.clear();
+    m_value_scopes.assign(1, {});
+    m_variable_versions.clear();
+    m_memory_epoch = 0;
+    m_variables.clear();
+    // arguments and the result are in the outermost scope of the function
+    enter_scope();
+    s_passes.run("value-numbering", [&] {
+        count_value_shapes(decl->body);
+        return true;
+    });
+    std::unordered_map<std::string, size_t> calls;
+    collect_calls(decl->body, calls);
+    // functions that don't call anything can keep their locals in the red zone
+    // below rsp, without setting up a frame at all
+    bool is_leaf = calls.empty() && s_passes.is_enabled("frame-elision");
+    m_omit_frame_pointer = is_leaf || m_options.omit_frame_pointer;
+    // variables can live in any register that none of the calls clobber or
+    // pass arguments in, so they never have to be saved around a call
+    m_available_temporaries.assign(std::begin(m_temporary_registers), std::end(m_temporary_registers));
+    m_variable_registers.clear();
+    m_out_of_temporaries = false;
+    s_passes.run("register-variables", [&] {
+        std::set<std::string> blocked_registers;
+        for (const auto& [name, argument_count] : calls) {
+            auto clobbers = clobbered_by_call(name);
+            blocked_registers.insert(clobbers.begin(), clobbers.end());
+            for (size_t i = 0; i < std::min(argument_slot_count(name, argument_count), std::size(m_arg_registers)); ++i) {
+                blocked_registers.insert(m_arg_registers[i]);
+            }
+        }
+        std::copy_if(std::begin(m_temporary_registers), std::end(m_temporary_registers), std::back_inserter(m_variable_registers), [&](const std::string& reg) {
+            return !blocked_registers.contains(reg);
+        });
+        return true;
+    });
+    m_clobbered_registers = { "rax" };
+    add_newline();
+    add_comment(generate_signature(decl), false);
+    size_t fn_start_index = m_asm_text.size();
+    add_label(decl->name->name);
+    add_push_callee_saved_registers();
+    if (!m_omit_frame_pointer) {
+        add_instr("push rbp");
+        add_instr("mov rbp, rsp");
+    }
+    size_t frame_setup_index = m_asm_text.size();
+    // arguments stay where they're passed in if they can, before anything else
+    // takes their register, but like any variable only while enough registers
+    // are left for temporaries. The others are moved to the stack.
+    std::vector<std::string> arg_locations;
+    if (decl->arguments) {
+        for (size_t i = 0; i < argument_slot_count(decl->name->name, decl->arguments->variables.size()); ++i) {
+            if (i >= std::size(m_arg_registers)) {
+                arg_locations.push_back(incoming_argument_location(i));
+            } else if (std::find(m_variable_registers.begin(), m_variable_registers.end(), m_arg_registers[i]) != m_variable_registers.end()
+                && m_available_temporaries.size() > s_reserved_temporaries) {
+                take_variable_register(m_arg_registers[i]);
+                arg_locations.push_back(m_arg_registers[i]);
+            } else {
+                arg_locations.push_back("");
+            }
+        }
+    }
+    std::string return_value_storage = "0";
+    if (decl->result) {
+        Type result_type;
+        if (!get_type_by_name(result_type, decl->result->type_name->name)) {
+            lk::log::error() << "'" << decl->result->type_name->name << "' is not a known type" << std::endl;
+            return false;
+        }
+        if (result_type.name == s_str_type.name) {
+            error("results are returned in one register, so " + decl->name->name + "() can't return a str");
+            return false;
+        }
+        if (!register_identifier(*decl->result->identifier, result_type, return_value_storage)) {
+            return false;
+        }
+        add_comment(return_value_storage + " = " + decl->result->identifier->name);
+        if (m_options.debug) {
+            // makes results that are never assigned easy to spot
+            add_comment("setting " + return_value_storage + " to debug value");
+            add_instr_mov("rax", "0xdeadc0de");
+            add_instr_mov(return_value_storage, "rax");
+        }
+    }
+    if (decl->arguments) {
+        size_t i = 0;
+        for (const auto& arg : decl->arguments->variables) {
+            Type var_type;
+            if (!get_type_by_name(var_type, arg->type_name->name)) {
+                lk::log::error() << "'" << arg->type_name->name << "' is not a known type" << std::endl;
+                return false;
+            }
+            bool is_str = var_type.name == s_str_type.name;
+            std::string location;
+            if (!register_identifier(*arg->identifier, var_type, location, arg_locations.at(i), is_str ? arg_locations.at(i + 1) : "")) {
+                return false;
+            }
+            add_comment(location + " = " + arg->identifier->name);
+            if (i < std::size(m_arg_registers)) {
+                add_instr_mov(location, m_arg_registers[i]);
+            }
+            ++i;
+            if (is_str) {
+                const auto& length_location = m_variables.find(arg->identifier->symbol)->length_location;
+                add_comment(length_location + " = str_len(" + arg->identifier->name + ")");
+                if (i < std::size(m_arg_registers)) {
+                    add_instr_mov(length_location, m_arg_registers[i]);
+                }
+                ++i;
+            }
+        }
+    }
+    bool ok = compile_body(decl->body);
+    if (!ok || m_out_of_temporaries) {
+        return false;
+    }
+    // outgoing arguments go at the bottom of the frame, locals at the top
+    size_t locals_size = m_current_stack_ptr + m_outgoing_args_size;
+    size_t frame_size;
+    if (!m_omit_frame_pointer) {
+        // rsp is 16 byte aligned after `push rbp`, keep it that way for calls
+        frame_size = (locals_size + 15) / 16 * 16;
+    } else if (is_leaf && locals_size <= 128) {
+        frame_size = 0;
+    } else {
+        // rsp is 8 off a 16 byte alignment on entry because of the return address
+        frame_size = (locals_size + 8 + 15) / 16 * 16 - 8;
+    }
+    add_pop_callee_saved_registers();
+    add_instr_mov("rax", return_value_storage);
+    if (!m_omit_frame_pointer) {
+        add_instr("leave");
+    } else if (frame_size > 0) {
+        add_instr("add rsp, " + std::to_string(frame_size));
+    }
+    add_instr_ret(decl->name->name);
+    if (frame_size > 0) {
+        m_asm_text.insert(m_asm_text.begin() + frame_setup_index, tab() + "sub rsp, " + std::to_string(frame_size));
+    }
+    if (m_omit_frame_pointer) {
+        m_asm_text.insert(m_asm_text.begin() + fn_start_index, "%define __frame_size " + std::to_string(frame_size));
+        m_asm_text.push_back("%undef __frame_size");
+    }
+    m_clobber_sets[decl->name->name] = m_clobbered_registers;
+    return true;
+}
+
+bool Object::compile_body(const std::shared_ptr<AST::Body>& body) {
+    enter_scope();
+    for (const auto& statement : body->statements->statements) {
+        bool ok = compile_statement(statement);
+        if (!ok) {
+            return false;
+        }
+    }
+    leave_scope();
+    return true;
+}
+
+bool Object::compile_statement(const std::shared_ptr<AST::Statement>& stmt) {
+    // no temporaries live across statements
+    release_temporaries();
+    if (auto assignment = dynamic_cast<AST::Assignment*>(stmt->statement.get())) {
+        bool ok = compile_assignment(assignment);
+        if (!ok) {
+            return false;
+        }
+    } else if (auto fncall = dynamic_cast<AST::FunctionCall*>(stmt->statement.get())) {
+        std::string ignored_result;
+        // TODO: warn ^
+        bool ok = compile_function_call(fncall, ignored_result);
+        if (!ok) {
+            return false;
+        }
+    } else if (auto decl = dynamic_cast<AST::VariableDecl*>(stmt->statement.get())) {
+        bool ok = compile_variable_decl(decl);
+        if (!ok) {
+            return false;
+        }
+    } else if (auto if_stmt = dynamic_cast<AST::IfStatement*>(stmt->statement.get())) {
+        bool ok = compile_if_statement(if_stmt);
+        if (!ok) {
+            return false;
+        }
+    } else if (auto match_stmt = dynamic_cast<AST::MatchStatement*>(stmt->statement.get())) {
+        bool ok = compile_match_statement(match_stmt);
+        if (!ok) {
+            return false;
+        }
+    } else {
+        error("statement is not assignment, function call, if or match statement, but should be.");
+        return false;
+    }
+    return true;
+}
+
+bool Object::compile_if_statement(const AST::IfStatement* stmt) {
+    std::string cond_result;
+    add_comment("condition of if-statement");
+    bool ok = compile_expression(stmt->condition, cond_result);
+    if (!ok) {
+        return false;
+    }
+    // `if (c) { x = a; } else { x = b; }` and `if (c) { x = a; }` can be lowered
+    // to a select without any jumps, as long as a and b are cheap and safe to
+    // evaluate unconditionally
+    const AST::Assignment* then_assignment = get_single_assignment(stmt->body);
+    const AST::Assignment* else_assignment = nullptr;
+    // built once, and compiled in the branches if it can't be a select,
+    // since building them evaluates calls at compile time
+    std::shared_ptr<ExpressionNode> then_node;
+    std::shared_ptr<ExpressionNode> else_node;
+    if (then_assignment) {
+        if (stmt->else_statement) {
+            else_assignment = get_single_assignment(stmt->else_statement->body);
+        }
+        bool is_diamond = else_assignment && else_assignment->identifier->symbol == then_assignment->identifier->symbol;
+        // a str takes two moves, which a select can't do
+        if ((!stmt->else_statement || is_diamond)
+            && !is_str_variable(*then_assignment->identifier)
+            && is_side_effect_free(then_assignment->expression)
+            && (!else_assignment || is_side_effect_free(else_assignment->expression))
+            && s_passes.is_enabled("branchless-if")) {
+            then_node = make_expression_node(then_assignment->expression);
+            else_node = else_assignment ? make_expression_node(else_assignment->expression) : nullptr;
+            if (!then_node || (else_assignment && !else_node)) {
+                return false;
+            }
+            // both values are held in temporaries at the same time, and the
+            // condition too if it's in rax, which evaluating them overwrites.
+            // Without enough of them, this has to branch instead.
+            size_t then_need = std::max<size_t>(then_node->need, 1);
+            size_t else_need = else_node ? std::max<size_t>(else_node->need, 1) : 1;
+            size_t need = std::max(then_need, 1 + else_need) + (cond_result == "rax" ? 1 : 0);
+            if (free_temporary_count() >= need) {
+                return s_passes.run("branchless-if", [&] {
+                    return compile_branchless_if_statement(cond_result, then_assignment, then_node, else_assignment, else_node);
+                });
+            }
+        }
+    }
+    std::string else_label = generate_unique_label();
+    std::string end_label = generate_unique_label();
+    add_instr_test(cond_result);
+    free_temporary(cond_result);
+    add_comment("jump to else/end");
+    add_instr("je " + else_label);
+    add_comment("if body");
+    // the body is just the assignment whose value is already built
+    auto compile_branch = [&](const std::shared_ptr<AST::Body>& body, const AST::Assignment* assignment, const std::shared_ptr<ExpressionNode>& node) {
+        if (!node) {
+            return compile_body(body);
+        }
+        enter_scope();
+        release_temporaries();
+        bool ok = compile_assignment(assignment, node);
+        leave_scope();
+        return ok;
+    };
+    // values computed before the if-statement are available in both branches,
+    // values computed in a branch are not available after it
+    auto before = save_value_state();
+    enter_value_scope();
+    ok = compile_branch(stmt->body, then_assignment, then_node);
+    leave_value_scope();
+    if (!ok) {
+        return false;
+    }
+    auto after_body = save_value_state();
+    if (stmt->else_statement) {
+        add_comment("jump to end, past the else");
+        add_instr("jmp " + end_label);
+        add_label(else_label);
+        restore_value_state(before);
+        enter_value_scope();
+        if (else_node) {
+            add_comment("else body");
+            ok = compile_branch(stmt->else_statement->body, else_assignment, else_node);
+        } else {
+            ok = compile_else_statement(stmt->else_statement);
+        }
+        leave_value_scope();
+        if (!ok) {
+            return false;
+        }
+        merge_value_states(before, { after_body, save_value_state() });
+        add_label(end_label);
+    } else {
+        merge_value_states(before, { after_body });
+        add_label(else_label);
+    }
+    return true;
+}
+
+bool Object::compile_branchless_if_statement(const std::string& condition, const AST::Assignment* then_assignment, const std::shared_ptr<ExpressionNode>& then_node, const AST::Assignment* else_assignment, const std::shared_ptr<ExpressionNode>& else_node) {
+    const auto& name = then_assignment->identifier->name;
+    auto symbol = then_assignment->identifier->symbol;
+    std::string target;
+    if (!get_location_for_identifier(*then_assignment->identifier, target)) {
+        return false;
+    }
+    add_comment("branchless if-statement assigning " + name);
+    // both values have to be in registers at the same time
+    auto compile_into_register = [this](const std::shared_ptr<ExpressionNode>& node, std::string& out) {
+        bool ok = compile_expression_node(node, "", out);
+        if (ok && !is_temporary(out)) {
+            auto reg = allocate_temporary();
+            add_instr_mov(reg, out);
+            out = reg;
+        }
+        return ok;
+    };
+    // the values are evaluated after the condition, and mustn't overwrite it
+    std::string cond_result = condition;
+    if (cond_result == "rax") {
+        cond_result = allocate_temporary();
+        add_instr_mov(cond_result, "rax");
+    }
+    if (else_assignment
+        && is_numeric_literal(then_assignment->expression, 1)
+        && is_numeric_literal(else_assignment->expression, 0)) {
+        add_comment(name + " = condition != 0");
+        add_instr_test(cond_result);
+        add_instr("setnz al");
+        add_instr("movzx eax, al");
+        add_instr_mov(target, "rax");
+        invalidate_variable(symbol);
+        return true;
+    }
+    if (else_assignment
+        && is_numeric_literal(then_assignment->expression, 0)
+        && is_numeric_literal(else_assignment->expression, 1)) {
+        add_comment(name + " = condition == 0");
+        add_instr_test(cond_result);
+        add_instr("setz al");
+        add_instr("movzx eax, al");
+        add_instr_mov(target, "rax");
+        invalidate_variable(symbol);
+        return true;
+    }
+    std::string then_result;
+    bool ok = compile_into_register(then_node, then_result);
+    if (!ok) {
+        return false;
+    }
+    std::string else_result;
+    if (else_assignment) {
+        ok = compile_into_register(else_node, else_result);
+        if (!ok) {
+            return false;
+        }
+    } else {
+        // without an else, the "else" value is whatever the variable held before
+        else_result = allocate_temporary();
+        add_instr_mov(else_result, target);
+    }
+    add_comment(name + " = condition ? " + then_result + " : " + else_result);
+    // the values are in temporaries, so rax is free for testing a constant
+    add_instr_test(cond_result);
+    add_instr("cmovnz " + else_result + ", " + then_result);
+    add_instr_mov(target, else_result);
+    invalidate_variable(symbol);
+    return true;
+}
+
+bool Object::compile_else_statement(const std::shared_ptr<AST::ElseStatement>& stmt) {
+    add_comment("else body");
+    bool ok = compile_body(stmt->body);
+    return ok;
+}
+
+bool Object::compile_match_statement(const AST::MatchStatement* stmt) {
+    std::string cond_result;
+    add_comment("value of match-statement");
+    bool ok = compile_expression(stmt->condition, cond_result);
+    if (!ok) {
+        return false;
+    }
+    // (value, index of the case it belongs to), sorted by value
+    std::vector<std::pair<size_t, size_t>> cases;
+    std::vector<std::string> case_labels;
+    for (size_t i = 0; i < stmt->cases.size(); ++i) {
+        for (auto value : stmt->cases.at(i)->values) {
+            cases.emplace_back(value, i);
+        }
+        case_labels.push_back(generate_unique_label());
+    }
+    std::sort(cases.begin(), cases.end());
+    for (size_t i = 1; i < cases.size(); ++i) {
+        if (cases.at(i).first == cases.at(i - 1).first) {
+            error("duplicate case " + std::to_string(cases.at(i).first) + " in match-statement");
+            return false;
+        }
+    }
+    std::string default_label = generate_unique_label();
+    std::string end_label = generate_unique_label();
+
+    add_instr_mov("rax", cond_result);
+    free_temporary(cond_result);
+    // variables may live in any other register
+    std::string scratch = allocate_temporary();
+    free_temporary(scratch);
+    if (!cases.empty()) {
+        size_t span = cases.back().first - cases.front().first;
+        // bit tests only pay off for few distinct targets, jump tables only for
+        // dense values, everything else becomes a balanced compare tree
+        if (span < 64 && stmt->cases.size() <= 3 && cases.size() >= 3 && s_passes.is_enabled("bit-tests")) {
+            s_passes.run("bit-tests", [&] {
+                add_match_bit_tests(cases, case_labels, default_label, scratch);
+                return true;
+            });
+        } else if (cases.size() >= 4 && span <= 4096 && span / 3 < cases.size() && s_passes.is_enabled("jump-tables")) {
+            s_passes.run("jump-tables", [&] {
+                add_match_jump_table(cases, case_labels, default_label, scratch);
+                return true;
+            });
+        } else {
+            add_comment("compare tree over " + std::to_string(cases.size()) + " cases");
+            add_match_compare_tree(cases, 0, cases.size(), case_labels, default_label, scratch);
+        }
+    } else {
+        add_instr("jmp " + default_label);
+    }
+
+    auto before = save_value_state();
+    std::vector<ValueState> branches;
+    for (size_t i = 0; i < stmt->cases.size(); ++i) {
+        add_label(case_labels.at(i));
+        add_comment("match case " + std::to_string(i));
+        restore_value_state(before);
+        enter_value_scope();
+        ok = compile_body(stmt->cases.at(i)->body);
+        leave_value_scope();
+        if (!ok) {
+            return false;
+        }
+        branches.push_back(save_value_state());
+        add_instr("jmp " + end_label);
+    }
+    add_label(default_label);
+    restore_value_state(before);
+    if (stmt->else_statement) {
+        enter_value_scope();
+        ok = compile_else_statement(stmt->else_statement);
+        leave_value_scope();
+        if (!ok) {
+            return false;
+        }
+    }
+    branches.push_back(save_value_state());
+    merge_value_states(before, branches);
+    add_label(end_label);
+    return true;
+}
+
+void Object::add_match_bit_tests(const std::vector<std::pair<size_t, size_t>>& cases, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch) {
+    size_t min = cases.front().first;
+    size_t span = cases.back().first - min;
+    add_comment("bit tests over " + std::to_string(cases.size()) + " cases");
+    add_instr_sub_imm("rax", min, scratch);
+    add_instr_cmp_imm("rax", span, scratch);
+    add_instr("ja " + default_label);
+    std::vector<size_t> masks(case_labels.size(), 0);
+    for (const auto& [value, index] : cases) {
+        masks.at(index) |= size_t(1) << (value - min);
+    }
+    for (size_t i = 0; i < masks.size(); ++i) {
+        if (masks.at(i) == 0) {
+            continue;
+        }
+        add_instr_mov(scratch, std::to_string(masks.at(i)));
+        add_instr("bt " + scratch + ", rax");
+        add_instr("jc " + case_labels.at(i));
+    }
+    add_instr("jmp " + default_label);
+}
+
+void Object::add_match_jump_table(const std::vector<std::pair<size_t, size_t>>& cases, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch) {
+    size_t min = cases.front().first;
+    size_t span = cases.back().first - min;
+    std::string table_label = generate_unique_label();
+    add_comment("jump table over " + std::to_string(cases.size()) + " cases");
+    add_instr_sub_imm("rax", min, scratch);
+    add_instr_cmp_imm("rax", span, scratch);
+    add_instr("ja " + default_label);
+    add_instr("jmp qword [" + table_label + " + rax*8]");
+    m_asm_rodata.push_back(table_label + ":");
+    auto iter = cases.begin();
+    for (size_t i = 0; i <= span; ++i) {
+        if (iter != cases.end() && iter->first - min == i) {
+            m_asm_rodata.push_back(tab() + "dq " + case_labels.at(iter->second));
+            ++iter;
+        } else {
+            m_asm_rodata.push_back(tab() + "dq " + default_label);
+        }
+    }
+}
+
+void Object::add_match_compare_tree(const std::vector<std::pair<size_t, size_t>>& cases, size_t begin, size_t end, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch) {
+    if (end - begin <= 3) {
+        for (size_t i = begin; i < end; ++i) {
+            add_instr_cmp_imm("rax", cases.at(i).first, scratch);
+            add_instr("je " + case_labels.at(cases.at(i).second));
+        }
+        add_instr("jmp " + default_label);
+        return;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    std::string lower_label = generate_unique_label();
+    add_instr_cmp_imm("rax", cases.at(mid).first, scratch);
+    add_instr("je " + case_labels.at(cases.at(mid).second));
+    add_instr("jb " + lower_label);
+    add_match_compare_tree(cases, mid + 1, end, case_labels, default_label, scratch);
+    add_label(lower_label);
+    add_match_compare_tree(cases, begin, mid, case_labels, default_label, scratch);
+}
+
+bool Object::compile_variable_decl(const AST::VariableDecl* decl) {
+    Type var_type;
+    if (!get_type_by_name(var_type, decl->type_name->name)) {
+        lk::log::error() << "type '" << decl->type_name->name << "' for variable '" << decl->identifier->name << "' is not known" << std::endl;
+        return false;
+    }
+    std::string location;
+    if (!register_identifier(*decl->identifier, var_type, location)) {
+        return false;
+    }
+    add_comment(location + " = " + decl->type_name->name + " " + decl->identifier->name);
+    if (var_type.name == s_str_type.name) {
+        add_comment(m_variables.find(decl->identifier->symbol)->length_location + " = str_len(" + decl->identifier->name + ")");
+    }
+    invalidate_variable(decl->identifier->symbol);
+    return true;
+}
+
+bool Object::compile_assignment(const AST::Assignment* assignment) {
+    if (is_str_variable(*assignment->identifier)) {
+        return compile_str_assignment(assignment);
+    }
+    auto node = make_expression_node(assignment->expression);
+    if (!node) {
+        return false;
+    }
+    return compile_assignment(assignment, node);
+}
+
+bool Object::compile_assignment(const AST::Assignment* assignment, const std::shared_ptr<ExpressionNode>& node) {
+    std::string expr_result;
+    bool ok = compile_expression(node, expr_result);
+    add_comment(assignment->identifier->name + " = " + expr_result);
+    if (!ok) {
+        return false;
+    }
+    assert(!expr_result.empty());
+    std::string target;
+    if (!get_location_for_identifier(*assignment->identifier, target)) {
+        return false;
+    }
+    add_instr_mov(target, expr_result);
+    invalidate_variable(assignment->identifier->symbol);
+    return true;
+}
+
+bool Object::compile_str_assignment(const AST::Assignment* assignment) {
+    std::shared_ptr<ExpressionNode> ptr;
+    std::shared_ptr<ExpressionNode> length;
+    if (!make_str_nodes(assignment->expression, ptr, length)) {
+        return false;
+    }
+    const auto& name = assignment->identifier->name;
+    const auto* variable = m_variables.find(assignment->identifier->symbol);
+    add_comment(name + " = " + ptr->value + ", " + length->value);
+    add_instr_mov(variable->location, ptr->value);
+    add_instr_mov(variable->length_location, length->value);
+    invalidate_variable(assignment->identifier->symbol);
+    return true;
+}
+
+bool Object::compile_expression(const std::shared_ptr<AST::Expression>& expr, std::string& out_result_reg) {
+    auto node = make_expression_node(expr);
+    if (!node) {
+        return false;
+    }
+    return compile_expression(node, out_result_reg);
+}
+
+bool Object::compile_expression(const std::shared_ptr<ExpressionNode>& node, std::string& out_result_reg) {
+    if (node->kind == ExpressionNode::Kind::Call && !lookup_value(node, out_result_reg)) {
+        // no need to move the result out of rax if nothing else is evaluated
+        bool ok = compile_call(node, out_result_reg);
+        if (ok) {
+            remember_value(node, out_result_reg);
+        }
+        return ok;
+    }
+    return compile_expression_node(node, "", out_result_reg);
+}
+
+std::shared_ptr<ExpressionNode> Object::make_expression_node(const std::shared_ptr<AST::Expression>& expr) {
+    return make_term_node(expr->term);
+}
+
+std::shared_ptr<ExpressionNode> Object::make_operation_node(const std::string& op, const std::shared_ptr<ExpressionNode>& left, const std::shared_ptr<ExpressionNode>& right) {
+    auto node = std::make_shared<ExpressionNode>();
+    node->kind = ExpressionNode::Kind::Operation;
+    node->value = op;
+    node->left = left;
+    node->right = right;
+    node->has_call = left->has_call || right->has_call;
+    // the right side may be used as an operand directly, without loading it
+    // into a register first
+    size_t left_need = left->need;
+    size_t right_need = right->kind == ExpressionNode::Kind::Operand && is_direct_source_operand(right->value) ? 0 : right->need;
+    if (left_need == right_need) {
+        node->need = left_need + 1;
+    } else {
+        node->need = std::max(left_need, right_need);
+    }
+    if (!left->key.empty() && !right->key.empty()) {
+        // `a + b` and `b + a` are the same value
+        bool swap = (op == "+" || op == "*") && std::tie(right->shape, right->key) < std::tie(left->shape, left->key);
+        const auto& a = swap ? right : left;
+        const auto& b = swap ? left : right;
+        node->shape = "(" + a->shape + op + b->shape + ")";
+        node->key = "(" + a->key + op + b->key + ")";
+        node->reads_memory = left->reads_memory || right->reads_memory;
+    }
+    return node;
+}
+
+std::shared_ptr<ExpressionNode> Object::make_term_node(const std::shared_ptr<AST::Term>& term) {
+    auto node = make_factor_node(term->factors.at(0));
+    for (size_t i = 1; node && i < term->factors.size(); ++i) {
+        auto right = make_factor_node(term->factors.at(i));
+        if (!right) {
+            return nullptr;
+        }
+        node = make_operation_node(term->operators.at(i - 1), node, right);
+    }
+    return node;
+}
+
+std::shared_ptr<ExpressionNode> Object::make_factor_node(const std::shared_ptr<AST::Factor>& factor) {
+    auto node = make_unary_node(factor->unaries.at(0));
+    for (size_t i = 1; node && i < factor->unaries.size(); ++i) {
+        if (factor->operators.at(i - 1) == "/") {
+            error("operator '/' is not implemented");
+            return nullptr;
+        }
+        auto right = make_unary_node(factor->unaries.at(i));
+        if (!right) {
+            return nullptr;
+        }
+        node = make_operation_node(factor->operators.at(i - 1), node, right);
+    }
+    return node;
+}
+
+std::shared_ptr<ExpressionNode> Object::make_unary_node(const std::shared_ptr<AST::Unary>& unary) {
+    if (!unary->op.empty()) {
+        assert(unary->op == "-");
+        error("unary operator '-' is not implemented");
+        return nullptr;
+    }
+    // we know its a primary since it's only a unary if there was a '-', which is not implemented
+    auto primary = dynamic_cast<AST::Primary*>(unary->unary_or_primary.get());
+    if (!primary) {
+        assert(!"unreachable code reached");
+        return nullptr;
+    }
+    if (auto grouped_expression = dynamic_cast<AST::GroupedExpression*>(primary->value.get())) {
+        return make_expression_node(grouped_expression->expression);
+    }
+    auto node = std::make_shared<ExpressionNode>();
+    if (auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get()); fncall && is_str_builtin(fncall->name->name)) {
+        const auto& name = fncall->name->name;
+        if (fncall->arguments.size() != 1) {
+            error(name + "() takes one str");
+            return nullptr;
+        }
+        std::shared_ptr<ExpressionNode> ptr;
+        std::shared_ptr<ExpressionNode> length;
+        if (!make_str_nodes(fncall->arguments.front(), ptr, length)) {
+            return nullptr;
+        }
+        auto result = name == "str_ptr" ? ptr : length;
+        result->shape = name + "(" + ptr->shape + ")";
+        return result;
+    }
+    if (auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get())) {
+        node->kind = ExpressionNode::Kind::Call;
+        node->call = fncall;
+        node->has_call = true;
+        // the result needs a register, and keeping one more free makes sure
+        // the arguments can always be evaluated
+        node->need = 2;
+        bool is_reusable = is_pure_function(fncall->name->name);
+        node->reads_memory = reads_memory(fncall->name->name);
+        std::string shape = fncall->name->name + "(";
+        std::string key = shape;
+        for (size_t i = 0; i < fncall->arguments.size(); ++i) {
+            const auto& arg = fncall->arguments.at(i);
+            std::shared_ptr<ExpressionNode> arg_node;
+            std::shared_ptr<ExpressionNode> length_node;
+            if (!make_argument_node(fncall, i, arg_node, length_node)) {
+                return nullptr;
+            }
+            node->need = std::max(node->need, arg_node->need);
+            node->arguments.push_back(arg_node);
+            if (length_node) {
+                node->arguments.push_back(length_node);
+            }
+            is_reusable = is_reusable && !arg_node->key.empty();
+            node->reads_memory = node->reads_memory || arg_node->reads_memory;
+            bool is_last = arg == fncall->arguments.back();
+            shape += arg_node->shape + (is_last ? "" : ",");
+            key += arg_node->key + (is_last ? "" : ",");
+        }
+        if (is_reusable) {
+            node->shape = shape + ")";
+            node->key = key + ")";
+        }
+        uint64_t value;
+        bool evaluated = false;
+        s_passes.run("compile-time-evaluation", [&] {
+            evaluated = evaluate_call(*node, value);
+            return true;
+        });
+        if (evaluated) {
+            add_comment(fncall->name->name + "() evaluated to " + std::to_string(value));
+            XC_TRACE(CallEvaluated, Trace::string(fncall->name->name), value);
+            auto result = std::make_shared<ExpressionNode>();
+            result->kind = ExpressionNode::Kind::Operand;
+            result->need = 1;
+            result->value = std::to_string(value);
+            result->shape = result->key = "#" + result->value;
+            return result;
+        }
+        return node;
+    }
+    node->kind = ExpressionNode::Kind::Operand;
+    node->need = 1;
+    if (auto numeric_literal = dynamic_cast<AST::NumericLiteral*>(primary->value.get())) {
+        node->value = std::to_string(numeric_literal->value);
+        node->shape = node->key = "#" + node->value;
+    } else if (auto string_literal = dynamic_cast<AST::StringLiteral*>(primary->value.get())) {
+        // used as a number, a literal is the address of its first character
+        size_t size;
+        node->value = add_string_literal(string_literal->value, size);
+        node->shape = "\"" + string_literal->value + "\"";
+        node->key = node->value;
+    } else if (auto identifier = dynamic_cast<AST::Identifier*>(primary->value.get())) {
+        if (is_str_variable(*identifier)) {
+            error("'" + identifier->name + "' is a str, which only str_ptr() and str_len() take apart");
+            return nullptr;
+        }
+        if (!get_location_for_identifier(*identifier, node->value)) {
+            return nullptr;
+        }
+        node->shape = identifier->name;
+        node->key = identifier->name + "@" + std::to_string(variable_version(identifier->symbol));
+    } else {
+        assert(!"unreachable code reached");
+        return nullptr;
+    }
+    return node;
+}
+
+bool Object::make_argument_node(AST::FunctionCall* fncall, size_t index, std::shared_ptr<ExpressionNode>& out, std::shared_ptr<ExpressionNode>& out_length) {
+    out_length = nullptr;
+    if (is_str_argument(fncall->name->name, index)) {
+        return make_str_nodes(fncall->arguments.at(index), out, out_length);
+    }
+    out = make_expression_node(fncall->arguments.at(index));
+    return out != nullptr;
+}
+
+// A str is either a string literal or a str variable, and both give the
+// pointer and the length as operands. The pointer has the shape and the key
+// of the whole str.
+bool Object::make_str_nodes(const std::shared_ptr<AST::Expression>& expr, std::shared_ptr<ExpressionNode>& out_ptr, std::shared_ptr<ExpressionNode>& out_length) {
+    auto value = expr->primary_value();
+    out_ptr = std::make_shared<ExpressionNode>();
+    out_ptr->kind = ExpressionNode::Kind::Operand;
+    out_ptr->need = 1;
+    out_length = std::make_shared<ExpressionNode>(*out_ptr);
+    if (auto string_literal = dynamic_cast<AST::StringLiteral*>(value)) {
+        size_t size;
+        out_ptr->value = add_string_literal(string_literal->value, size);
+        out_ptr->shape = "\"" + string_literal->value + "\"";
+        out_ptr->key = out_ptr->value;
+        out_length->value = std::to_string(size);
+        out_length->shape = out_length->key = "#" + out_length->value;
+        return true;
+    }
+    if (auto identifier = dynamic_cast<AST::Identifier*>(value); identifier && is_str_variable(*identifier)) {
+        const auto* variable = m_variables.find(identifier->symbol);
+        out_ptr->value = variable->location;
+        out_ptr->shape = identifier->name;
+        out_ptr->key = identifier->name + "@" + std::to_string(variable_version(identifier->symbol));
+        out_length->value = variable->length_location;
+        out_length->shape = "str_len(" + out_ptr->shape + ")";
+        out_length->key = "str_len(" + out_ptr->key + ")";
+        return true;
+    }
+    error("expected a string literal or a str variable");
+    return false;
+}
+
+std::string Object::add_string_literal(const std::string& value, size_t& out_size) {
+    // TODO: escape newlines, etc.
+    std::string final_string;
+    out_size = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char c = value[i + 1];
+            switch (c) {
+            case 'n':
+                final_string += "', 0xa, '";
+                ++out_size;
+                break;
+            case '\\':
+                final_string += c;
+                ++out_size;
+                break;
+            default:
+                XC_WARNING("unhandled escaped string '" + std::to_string(c) + "'.");
+                break;
+            }
+            ++i;
+        } else if (value[i] == '\'') {
+            final_string += "', 0x27, '";
+            ++out_size;
+        } else {
+            final_string += value[i];
+            ++out_size;
+        }
+    }
+    // numbered within the function, whose name keeps the labels of different
+    // functions apart also in code reused from an earlier compile. The linker
+    // merges a literal used by several functions into one copy anyways.
+    auto [label, inserted] = m_string_literal_labels.try_emplace(value, "__str_" + m_label_prefix + std::to_string(m_string_literal_labels.size()));
+    if (inserted) {
+        m_string_literals.emplace(label->second, value);
+        m_asm_strings.push_back(label->second + ": db '" + final_string + "', 0x0");
+    }
+    return label->second;
+}
+
+bool Object::evaluate_call(const ExpressionNode& node, uint64_t& out) {
+    const auto& name = node.call->name->name;
+    // builtins aren't functions in the VM, and are cheap to call anyways
+    if (s_pure_builtins.contains(name) || !is_pure_function(name)) {
+        return false;
+    }
+    for (const auto& arg : node.arguments) {
+        bool is_constant = arg->kind == ExpressionNode::Kind::Operand
+            && (std::isdigit(arg->value.front()) || m_string_literals.contains(arg->value));
+        if (!is_constant) {
+            return false;
+        }
+    }
+    auto& module = this->module();
+    std::lock_guard lock(module.m_evaluator_mutex);
+    if (!module.m_evaluator && !module.make_evaluator()) {
+        return false;
+    }
+    std::vector<uint64_t> arguments;
+    for (const auto& arg : node.arguments) {
+        if (auto literal = m_string_literals.find(arg->value); literal != m_string_literals.end()) {
+            size_t size;
+            arguments.push_back(module.m_evaluation_program->add_string(literal->second, size));
+        } else {
+            uint64_t value {};
+            std::from_chars(arg->value.data(), arg->value.data() + arg->value.size(), value);
+            arguments.push_back(value);
+        }
+    }
+    uint64_t result;
+    if (!module.m_evaluator->call(name, arguments, result)) {
+        XC_INFO("not evaluating call to " << name << "() at compile time: " << module.m_evaluator->error_message() << std::endl);
+        return false;
+    }
+    // addresses of the evaluator's strings mean nothing in the program
+    if (module.m_evaluation_program->is_string_address(result)) {
+        return false;
+    }
+    out = result;
+    return true;
+}
+
+bool Object::make_evaluator() {
+    if (m_evaluator_failed) {
+        return false;
+    }
+    // dependencies are compiled already, so their units can be reused instead
+    // of parsing them again
+    std::unordered_map<std::string, std::shared_ptr<AST::Unit>> units;
+    std::function<void(const Object&)> collect_units = [&](const Object& object) {
+        const auto& use_decls = object.unit()->use_decls;
+        for (size_t i = 0; i < use_decls.size() && i < object.dependencies().size(); ++i) {
+            units[use_decls.at(i)->path] = object.dependencies().at(i)->unit();
+            collect_units(*object.dependencies().at(i));
+        }
+    };
+    collect_units(*this);
+    VM::Compiler compiler([&units](const std::string& path) -> std::shared_ptr<AST::Unit> {
+        auto iter = units.find(path);
+        return iter != units.end() ? iter->second : nullptr;
+    });
+    auto program = std::make_unique<VM::Program>();
+    if (!compiler.add_unit(m_root) || !compiler.compile(*program)) {
+        m_evaluator_failed = true;
+        return false;
+    }
+    m_evaluation_program = std::move(program);
+    m_evaluator = std::make_unique<VM::Interpreter>(*m_evaluation_program);
+    // only string literals may be read, and nothing else may be done
+    m_evaluator->set_sandboxed(true);
+    m_evaluator->set_call_limit(m_options.evaluation_limit);
+    return true;
+}
+
+bool Object::compile_expression_node(const std::shared_ptr<ExpressionNode>& node, const std::string& hint, std::string& out) {
+    if (lookup_value(node, out)) {
+        return true;
+    }
+    switch (node->kind) {
+    case ExpressionNode::Kind::Operand:
+        out = node->value;
+        return true;
+    case ExpressionNode::Kind::Call: {
+        std::string call_result;
+        bool ok = compile_call(node, call_result);
+        if (!ok) {
+            return false;
+        }
+        // rax is scratch for everything else, so the result can't stay there
+        out = allocate_temporary(hint);
+        add_instr_mov(out, call_result);
+        remember_value(node, out);
+        return true;
+    }
+    case ExpressionNode::Kind::Operation:
+        break;
+    }
+    // Sethi-Ullman: evaluate the side needing more registers first, so that
+    // fewer results have to be held while evaluating the other side. Sides
+    // containing calls go first, so their results don't have to be saved
+    // across the call, but the order of two calls is never swapped.
+    bool right_first;
+    if (node->left->has_call != node->right->has_call) {
+        right_first = node->right->has_call;
+    } else if (node->left->has_call) {
+        right_first = false;
+    } else {
+        right_first = node->right->need > node->left->need;
+    }
+    const auto& first = right_first ? node->right : node->left;
+    const auto& second = right_first ? node->left : node->right;
+    std::string first_result;
+    bool ok = compile_expression_node(first, right_first ? "" : hint, first_result);
+    if (!ok) {
+        return false;
+    }
+    if (is_temporary(first_result) && second->kind != ExpressionNode::Kind::Operand && free_temporary_count() < second->need) {
+        // not enough registers left for the other side, so hold on to this one in memory
+        auto spill = stack_location(make_stack_ptr_for_size(8));
+        add_comment("spill " + first_result + " to " + spill);
+        add_instr_mov(spill, first_result);
+        free_temporary(first_result);
+        first_result = spill;
+    }
+    std::string second_result;
+    ok = compile_expression_node(second, right_first ? hint : "", second_result);
+    if (!ok) {
+        return false;
+    }
+    if (right_first) {
+        ok = compile_operation(node->value, second_result, first_result, hint, out);
+    } else {
+        ok = compile_operation(node->value, first_result, second_result, hint, out);
+    }
+    if (ok) {
+        remember_value(node, out);
+    }
+    return ok;
+}
+
+bool Object::compile_operation(const std::string& op, const std::string& left, const std::string& right, const std::string& hint, std::string& out_reg) {
+    bool is_commutative = op == "+" || op == "*";
+    std::string source;
+    if (is_temporary(left)) {
+        out_reg = left;
+        source = right;
+    } else if (is_commutative && is_temporary(right)) {
+        out_reg = right;
+        source = left;
+    } else if (is_temporary(right)) {
+        // `right = left - right` has to go through a scratch register
+        add_comment(right + " = " + left + " " + op + " " + right);
+        add_instr_mov("rax", left);
+        add_operation(op, "rax", right);
+        add_instr_mov(right, "rax");
+        out_reg = right;
+        return true;
+    } else {
+        out_reg = allocate_temporary(hint);
+        add_instr_mov(out_reg, left);
+        source = right;
+    }
+    add_comment(out_reg + " = " + left + " " + op + " " + right);
+    if (!is_direct_source_operand(source)) {
+        add_instr_mov("rax", source);
+        source = "rax";
+    }
+    add_operation(op, out_reg, source);
+    free_temporary(source);
+    return true;
+}
+
+void Object::add_operation(const std::string& op, const std::string& to, const std::string& from) {
+    if (op == "+") {
+        add_instr_add(to, from);
+    } else if (op == "-") {
+        add_instr_sub(to, from);
+    } else if (op == "*") {
+        add_instr_mul(to, from);
+    } else {
+        assert(!"not implemented");
+    }
+}
+
+bool Object::compile_function_call(AST::FunctionCall* fncall, std::string& out) {
+    auto node = std::make_shared<ExpressionNode>();
+    node->kind = ExpressionNode::Kind::Call;
+    node->call = fncall;
+    node->has_call = true;
+    for (size_t i = 0; i < fncall->arguments.size(); ++i) {
+        std::shared_ptr<ExpressionNode> arg_node;
+        std::shared_ptr<ExpressionNode> length_node;
+        if (!make_argument_node(fncall, i, arg_node, length_node)) {
+            return false;
+        }
+        node->arguments.push_back(arg_node);
+        if (length_node) {
+            node->arguments.push_back(length_node);
+        }
+    }
+    return compile_call(node, out);
+}
+
+bool Object::compile_call(const std::shared_ptr<ExpressionNode>& node, std::string& out) {
+    const auto& name = node->call->name->name;
+    const auto& arguments = node->arguments;
+    if (m_current_function->is_pure && !is_pure_function(name)) {
+        error("pure function " + m_current_function->name->name + "() calls " + name + "(), which is not pure");
+        return false;
+    }
+    add_comment("setup arguments to " + name + "()");
+    // arguments containing calls are evaluated first and in order, then the
+    // rest by register need
+    std::vector<size_t> order(arguments.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (arguments.at(a)->has_call != arguments.at(b)->has_call) {
+            return arguments.at(a)->has_call;
+        }
+        if (arguments.at(a)->has_call) {
+            return false;
+        }
+        return arguments.at(a)->need > arguments.at(b)->need;
+    });
+    std::vector<std::pair<std::string, std::string>> moves;
+    // arguments past the argument registers are passed at the bottom of the
+    // caller's frame
+    std::vector<std::pair<std::string, std::string>> stack_moves;
+    for (size_t i : order) {
+        std::string arg_result;
+        // try to evaluate straight into the register the argument is passed in
+        std::string hint = i < std::size(m_arg_registers) ? m_arg_registers[i] : "";
+        bool ok = compile_expression_node(arguments.at(i), hint, arg_result);
+        if (!ok) {
+            return false;
+        }
+        if (is_temporary(arg_result) && free_temporary_count() < 2) {
+            auto spill = stack_location(make_stack_ptr_for_size(8));
+            add_comment("spill " + name + "() arg " + std::to_string(i) + " to " + spill);
+            add_instr_mov(spill, arg_result);
+            free_temporary(arg_result);
+            arg_result = spill;
+        }
+        if (i < std::size(m_arg_registers)) {
+            moves.emplace_back(m_arg_registers[i], arg_result);
+        } else {
+            stack_moves.emplace_back("rsp+" + std::to_string(8 * (i - std::size(m_arg_registers))), arg_result);
+        }
+    }
+    m_outgoing_args_size = std::max(m_outgoing_args_size, 8 * stack_moves.size());
+    for (const auto& [to, from] : moves) {
+        free_temporary(from);
+    }
+    for (const auto& [to, from] : stack_moves) {
+        free_temporary(from);
+    }
+    // whatever is still live belongs to an enclosing expression, and has to be
+    // saved if the call or its argument setup clobbers it
+    auto clobbers = clobbered_by_call(name);
+    m_clobbered_registers.insert(clobbers.begin(), clobbers.end());
+    for (const auto& [to, from] : moves) {
+        clobbers.insert(to);
+    }
+    std::vector<std::pair<std::string, std::string>> saved;
+    for (const auto& reg : m_live_temporaries) {
+        if (!clobbers.contains(reg)) {
+            continue;
+        }
+        auto slot = stack_location(make_stack_ptr_for_size(8));
+        add_comment("save " + reg + " across call to " + name + "()");
+        add_instr_mov(slot, reg);
+        saved.emplace_back(reg, slot);
+    }
+    for (const auto& [to, from] : stack_moves) {
+        add_instr_mov(to, from);
+    }
+    add_parallel_move(moves);
+    add_comment("call to " + name + "()");
+    add_instr_call(name);
+    if (!is_pure_function(name)) {
+        invalidate_memory();
+    }
+    for (const auto& [reg, slot] : saved) {
+        add_instr_mov(reg, slot);
+    }
+    out = "rax";
+    return true;
+}
+
+void Object::add_parallel_move(std::vector<std::pair<std::string, std::string>> moves) {
+    // register to register moves have to be ordered so that no register is
+    // overwritten before it's read, breaking cycles with rax
+    std::vector<std::pair<std::string, std::string>> register_moves;
+    std::vector<std::pair<std::string, std::string>> other_moves;
+    for (const auto& move : moves) {
+        if (is_register(move.first)) {
+            m_clobbered_registers.insert(move.first);
+        }
+        if (move.first == move.second) {
+            continue;
+        } else if (is_register(move.second)) {
+            register_moves.push_back(move);
+        } else {
+            other_moves.push_back(move);
+        }
+    }
+    while (!register_moves.empty()) {
+        auto ready = std::find_if(register_moves.begin(), register_moves.end(), [&](const auto& move) {
+            return std::none_of(register_moves.begin(), register_moves.end(), [&](const auto& other) { return other.second == move.first; });
+        });
+        if (ready == register_moves.end()) {
+            // only cycles are left, break one up
+            auto& [to, from] = register_moves.front();
+            add_comment("break up move cycle at " + to);
+            add_instr_mov("rax", to);
+            for (auto& move : register_moves) {
+                if (move.second == to) {
+                    move.second = "rax";
+                }
+            }
+            continue;
+        }
+        add_instr_mov(ready->first, ready->second);
+        register_moves.erase(ready);
+    }
+    // these don't read any registers that could have been overwritten
+    for (const auto& [to, from] : other_moves) {
+        add_instr_mov(to, from);
+    }
+}
+
+std::string Object::allocate_temporary(const std::string& hint) {
+    auto is_free = [&](const std::string& reg) {
+        return std::find(m_live_temporaries.begin(), m_live_temporaries.end(), reg) == m_live_temporaries.end();
+    };
+    bool hint_available = std::find(m_available_temporaries.begin(), m_available_temporaries.end(), hint) != m_available_temporaries.end();
+    if (hint_available && is_free(hint)) {
+        m_live_temporaries.push_back(hint);
+        m_clobbered_registers.insert(hint);
+        return hint;
+    }
+    for (const auto& reg : m_available_temporaries) {
+        if (is_free(reg)) {
+            m_live_temporaries.push_back(reg);
+            m_clobbered_registers.insert(reg);
+            return reg;
+        }
+    }
+    // compile_function_decl() fails once the body is compiled, until then rax
+    // keeps the instructions well-formed
+    if (!m_out_of_temporaries) {
+        error("expression is too complex, ran out of temporary registers");
+        m_out_of_temporaries = true;
+    }
+    return "rax";
+}
+
+void Object::free_temporary(const std::string& location) {
+    auto iter = std::find(m_live_temporaries.begin(), m_live_temporaries.end(), location);
+    if (iter != m_live_temporaries.end()) {
+        m_live_temporaries.erase(iter);
+    }
+}
+
+bool Object::is_temporary(const std::string& location) const {
+    return std::find(m_live_temporaries.begin(), m_live_temporaries.end(), location) != m_live_temporaries.end();
+}
+
+size_t Object::free_temporary_count() const {
+    return m_available_temporaries.size() - m_live_temporaries.size();
+}
+
+void Object::release_temporaries() {
+    m_live_temporaries.clear();
+}
+
+bool Object::is_temporary_register(const std::string& location) {
+    return std::find(std::begin(m_temporary_registers), std::end(m_temporary_registers), location) != std::end(m_temporary_registers);
+}
+
+bool Object::is_register(const std::string& location) {
+    return location == "rax" || is_temporary_register(location);
+}
+
+bool Object::is_direct_source_operand(const std::string& location) {
+    // anything but a 64 bit constant can be used as the source of add, sub,
+    // imul, etc. directly
+    if (location.empty() || !std::isdigit(location.front())) {
+        return true;
+    }
+    size_t value {};
+    std::from_chars(location.data(), location.data() + location.size(), value);
+    return value <= 0x7fffffff;
+}
+
+void Object::count_value_shapes(const std::shared_ptr<AST::Body>& body) {
+    for (const auto& statement : body->statements->statements) {
+        if (auto assignment = dynamic_cast<AST::Assignment*>(statement->statement.get())) {
+            count_value_shapes(assignment->expression);
+        } else if (auto fncall = dynamic_cast<AST::FunctionCall*>(statement->statement.get())) {
+            count_value_shapes(fncall);
+        } else if (auto if_stmt = dynamic_cast<AST::IfStatement*>(statement->statement.get())) {
+            count_value_shapes(if_stmt->condition);
+            count_value_shapes(if_stmt->body);
+            if (if_stmt->else_statement) {
+                count_value_shapes(if_stmt->else_statement->body);
+            }
+        } else if (auto match_stmt = dynamic_cast<AST::MatchStatement*>(statement->statement.get())) {
+            count_value_shapes(match_stmt->condition);
+            for (const auto& match_case : match_stmt->cases) {
+                count_value_shapes(match_case->body);
+            }
+            if (match_stmt->else_statement) {
+                count_value_shapes(match_stmt->else_statement->body);
+            }
+        }
+    }
+}
+
+// has to produce the same shapes as make_expression_node()
+std::string Object::count_value_shapes(const std::shared_ptr<AST::Expression>& expr) {
+    auto count_operation = [this](const std::string& op, const std::string& left, const std::string& right) -> std::string {
+        if (left.empty() || right.empty()) {
+            return "";
+        }
+        bool swap = (op == "+" || op == "*") && right < left;
+        auto shape = "(" + (swap ? right : left) + op + (swap ? left : right) + ")";
+        ++m_value_shape_counts[shape];
+        return shape;
+    };
+    const auto& term = expr->term;
+    std::string term_shape;
+    for (size_t i = 0; i < term->factors.size(); ++i) {
+        const auto& factor = term->factors.at(i);
+        auto factor_shape = count_value_shapes(factor->unaries.at(0));
+        for (size_t k = 1; k < factor->unaries.size(); ++k) {
+            factor_shape = count_operation(factor->operators.at(k - 1), factor_shape, count_value_shapes(factor->unaries.at(k)));
+        }
+        term_shape = i == 0 ? factor_shape : count_operation(term->operators.at(i - 1), term_shape, factor_shape);
+    }
+    return term_shape;
+}
+
+std::string Object::count_value_shapes(const std::shared_ptr<AST::Unary>& unary) {
+    auto primary = dynamic_cast<AST::Primary*>(unary->unary_or_primary.get());
+    if (!unary->op.empty() || !primary) {
+        return "";
+    }
+    if (auto numeric_literal = dynamic_cast<AST::NumericLiteral*>(primary->value.get())) {
+        return "#" + std::to_string(numeric_literal->value);
+    } else if (auto string_literal = dynamic_cast<AST::StringLiteral*>(primary->value.get())) {
+        return "\"" + string_literal->value + "\"";
+    } else if (auto identifier = dynamic_cast<AST::Identifier*>(primary->value.get())) {
+        return identifier->name;
+    } else if (auto grouped_expression = dynamic_cast<AST::GroupedExpression*>(primary->value.get())) {
+        return count_value_shapes(grouped_expression->expression);
+    } else if (auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get())) {
+        return count_value_shapes(fncall);
+    }
+    return "";
+}
+
+std::string Object::count_value_shapes(AST::FunctionCall* fncall) {
+    // the parts of a str are operands, which aren't counted
+    if (is_str_builtin(fncall->name->name)) {
+        return fncall->arguments.size() == 1 ? fncall->name->name + "(" + count_value_shapes(fncall->arguments.front()) + ")" : "";
+    }
+    bool is_reusable = is_pure_function(fncall->name->name);
+    std::string shape = fncall->name->name + "(";
+    for (const auto& arg : fncall->arguments) {
+        auto arg_shape = count_value_shapes(arg);
+        is_reusable = is_reusable && !arg_shape.empty();
+        shape += arg_shape + (arg == fncall->arguments.back() ? "" : ",");
+    }
+    if (!is_reusable) {
+        return "";
+    }
+    shape += ")";
+    ++m_value_shape_counts[shape];
+    return shape;
+}
+
+std::string Object::value_key(const std::shared_ptr<ExpressionNode>& node) const {
+    if (node->reads_memory) {
+        return node->key + "@" + std::to_string(m_memory_epoch);
+    }
+    return node->key;
+}
+
+bool Object::lookup_value(const std::shared_ptr<ExpressionNode>& node, std::string& out) {
+    if (node->kind == ExpressionNode::Kind::Operand || node->key.empty()) {
+        return false;
+    }
+    // one less occurrence left that could reuse this value
+    auto& remaining = m_value_shape_counts[node->shape];
+    if (remaining > 0) {
+        --remaining;
+    }
+    auto key = value_key(node);
+    for (auto scope = m_value_scopes.rbegin(); scope != m_value_scopes.rend(); ++scope) {
+        auto iter = scope->find(key);
+        if (iter != scope->end()) {
+            add_comment("reusing " + node->shape + " from " + iter->second);
+            out = iter->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Object::remember_value(const std::shared_ptr<ExpressionNode>& node, const std::string& location) {
+    // only worth a store if the same expression shows up again later
+    if (node->key.empty() || m_value_shape_counts[node->shape] == 0 || !is_register(location)) {
+        return;
+    }
+    auto slot = stack_location(make_stack_ptr_for_size(8));
+    add_comment("keep " + node->shape + " in " + slot);
+    add_instr_mov(slot, location);
+    m_value_scopes.back()[value_key(node)] = slot;
+}
+
+size_t Object::variable_version(SymbolId symbol) const {
+    auto iter = m_variable_versions.find(symbol);
+    if (iter == m_variable_versions.end()) {
+        return 0;
+    }
+    return iter->second;
+}
+
+void Object::invalidate_variable(SymbolId symbol) {
+    m_variable_versions[symbol] = ++m_value_version_counter;
+}
+
+void Object::invalidate_memory() {
+    m_memory_epoch = ++m_value_version_counter;
+}
+
+void Object::enter_value_scope() {
+    m_value_scopes.emplace_back();
+}
+
+void Object::leave_value_scope() {
+    m_value_scopes.pop_back();
+}
+
+Object::ValueState Object::save_value_state() const {
+    return ValueState { m_variable_versions, m_memory_epoch };
+}
+
+void Object::restore_value_state(const ValueState& state) {
+    m_variable_versions = state.variable_versions;
+    m_memory_epoch = state.memory_epoch;
+}
+
+void Object::merge_value_states(const ValueState& before, const std::vector<ValueState>& branches) {
+    // anything changed in any branch has an unknown value after the branches join
+    std::unordered_set<SymbolId> changed;
+    bool memory_changed = false;
+    for (const auto& branch : branches) {
+        for (const auto& [id, version] : branch.variable_versions) {
+            auto iter = before.variable_versions.find(id);
+            if (iter == before.variable_versions.end() || iter->second != version) {
+                changed.insert(id);
+            }
+        }
+        memory_changed = memory_changed || branch.memory_epoch != before.memory_epoch;
+    }
+    restore_value_state(before);
+    for (const auto& id : changed) {
+        invalidate_variable(id);
+    }
+    if (memory_changed) {
+        invalidate_memory();
+    }
+}
+
+bool Object::is_pure_function(const std::string& name) const {
+    return s_pure_builtins.contains(name) || module().m_pure_functions.contains(name);
+}
+
+bool Object::reads_memory(const std::string& function_name) const {
+    auto iter = s_pure_builtins.find(function_name);
+    if (iter != s_pure_builtins.end()) {
+        return iter->second;
+    }
+    // pure user functions may still dereference their arguments
+    return true;
+}
+
+static bool is_side_effect_free(const std::shared_ptr<AST::Unary>& unary);
+
+static bool is_side_effect_free(const std::shared_ptr<AST::Expression>& expr) {
+    for (const auto& factor : expr->term->factors) {
+        for (const auto& op : factor->operators) {
+            // division is not implemented, and would fault on zero anyways
+            if (op == "/") {
+                return false;
+            }
+        }
+        for (const auto& unary : factor->unaries) {
+            if (!is_side_effect_free(unary)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool is_side_effect_free(const std::shared_ptr<AST::Unary>& unary) {
+    if (!unary->op.empty()) {
+        return false;
+    }
+    auto primary = dynamic_cast<AST::Primary*>(unary->unary_or_primary.get());
+    if (!primary) {
+        return false;
+    }
+    if (auto grouped_expression = dynamic_cast<AST::GroupedExpression*>(primary->value.get())) {
+        return is_side_effect_free(grouped_expression->expression);
+    }
+    // function calls may do anything, except taking apart a str
+    auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get());
+    return !fncall || is_str_builtin(fncall->name->name);
+}
+
+static void collect_calls(AST::FunctionCall* fncall, std::unordered_map<std::string, size_t>& calls);
+
+static void collect_calls(const std::shared_ptr<AST::Expression>& expr, std::unordered_map<std::string, size_t>& calls) {
+    for (const auto& factor : expr->term->factors) {
+        for (const auto& unary : factor->unaries) {
+            auto node = unary->unary_or_primary;
+            // skip over unary operators
+            while (auto inner = dynamic_cast<AST::Unary*>(node.get())) {
+                node = inner->unary_or_primary;
+            }
+            auto primary = dynamic_cast<AST::Primary*>(node.get());
+            if (!primary) {
+                continue;
+            }
+            if (auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get())) {
+                collect_calls(fncall, calls);
+            } else if (auto grouped_expression = dynamic_cast<AST::GroupedExpression*>(primary->value.get())) {
+                collect_calls(grouped_expression->expression, calls);
+            }
+        }
+    }
+}
+
+static void collect_calls(AST::FunctionCall* fncall, std::unordered_map<std::string, size_t>& calls) {
+    // those don't compile to a call
+    if (!is_str_builtin(fncall->name->name)) {
+        auto& argument_count = calls[fncall->name->name];
+        argument_count = std::max(argument_count, fncall->arguments.size());
+    }
+    for (const auto& arg : fncall->arguments) {
+        collect_calls(arg, calls);
+    }
+}
+
+static void collect_calls(const std::shared_ptr<AST::Body>& body, std::unordered_map<std::string, size_t>& calls) {
+    for (const auto& statement : body->statements->statements) {
+        if (auto assignment = dynamic_cast<AST::Assignment*>(statement->statement.get())) {
+            collect_calls(assignment->expression, calls);
+        } else if (auto fncall = dynamic_cast<AST::FunctionCall*>(statement->statement.get())) {
+            collect_calls(fncall, calls);
+        } else if (auto if_stmt = dynamic_cast<AST::IfStatement*>(statement->statement.get())) {
+            collect_calls(if_stmt->condition, calls);
+            collect_calls(if_stmt->body, calls);
+            if (if_stmt->else_statement) {
+                collect_calls(if_stmt->else_statement->body, calls);
+            }
+        } else if (auto match_stmt = dynamic_cast<AST::MatchStatement*>(statement->statement.get())) {
+            collect_calls(match_stmt->condition, calls);
+            for (const auto& match_case : match_stmt->cases) {
+                collect_calls(match_case->body, calls);
+            }
+            if (match_stmt->else_statement) {
+                collect_calls(match_stmt->else_statement->body, calls);
+            }
+        }
+    }
+}
+
+static void remove_jumps_to_next_instruction(std::vector<std::string>& text) {
+    // `jmp label` followed by only comments and other labels up to `label:`
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto jmp = text.at(i).find("jmp ");
+        if (jmp == std::string::npos || text.at(i).find_first_not_of(' ') != jmp) {
+            continue;
+        }
+        auto target = text.at(i).substr(jmp + 4) + ":";
+        for (size_t k = i + 1; k < text.size(); ++k) {
+            const auto& line = text.at(k);
+            if (line == target) {
+                text.erase(text.begin() + i);
+                --i;
+                break;
+            }
+            auto first = line.find_first_not_of(' ');
+            bool is_label = !line.empty() && line.back() == ':' && first == 0;
+            bool is_comment = first != std::string::npos && line.at(first) == ';';
+            if (!is_label && !is_comment && first != std::string::npos) {
+                break;
+            }
+        }
+    }
+}
+
+static void remove_unreferenced_strings(const std::vector<std::string>& text, std::vector<std::string>& strings) {
+    if (strings.empty()) {
+        return;
+    }
+    std::unordered_set<std::string> referenced;
+    for (const auto& line : text) {
+        // comments mention literals of folded calls too
+        auto end = std::min(line.find(';'), line.size());
+        for (auto begin = line.find("__str_"); begin < end; begin = line.find("__str_", begin)) {
+            auto label_end = begin;
+            while (label_end < end && (std::isalnum(static_cast<unsigned char>(line.at(label_end))) || line.at(label_end) == '_')) {
+                ++label_end;
+            }
+            referenced.insert(line.substr(begin, label_end - begin));
+            begin = label_end;
+        }
+    }
+    std::erase_if(strings, [&](const std::string& line) {
+        return !referenced.contains(line.substr(0, line.find(':')));
+    });
+}
+
+static const AST::Assignment* get_single_assignment(const std::shared_ptr<AST::Body>& body) {
+    const auto& statements = body->statements->statements;
+    if (statements.size() != 1) {
+        return nullptr;
+    }
+    return dynamic_cast<AST::Assignment*>(statements.front()->statement.get());
+}
+
+static bool is_numeric_literal(const std::shared_ptr<AST::Expression>& expr, size_t value) {
+    const auto& factors = expr->term->factors;
+    if (factors.size() != 1 || factors.front()->unaries.size() != 1) {
+        return false;
+    }
+    const auto& unary = factors.front()->unaries.front();
+    if (!unary->op.empty()) {
+        return false;
+    }
+    auto primary = dynamic_cast<AST::Primary*>(unary->unary_or_primary.get());
+    if (!primary) {
+        return false;
+    }
+    auto literal = dynamic_cast<AST::NumericLiteral*>(primary->value.get());
+    return literal && literal->value == value;
+}
+
+static bool is_str_builtin(const std::string& name) {
+    return std::find(str_builtins.begin(), str_builtins.end(), name) != str_builtins.end();
+}
+
+void Object::add_comment(const std::string& comment, bool do_indent) {
+    std::string line;
+    if (do_indent) {
+        line += tab();
+    }
+    line += "; " + comment;
+    m_asm_text.push_back(line);
+}
+
+void Object::add_newline() {
+    m_asm_text.push_back("");
+}
+
+void Object::add_label(const std::string& label) {
+    m_asm_text.push_back(label + ":");
+}
+
+void Object::add_instr(const std::string& instr) {
+    m_asm_text.push_back(tab() + instr);
+}
+
+void Object::add_instr_ret(const std::string& from) {
+    add_comment("return from " + from);
+    m_asm_text.push_back(tab() + "ret");
+}
+
+void Object::add_instr_mov(const std::string& to, const std::string& from) {
+    std::string real_to = to;
+    std::string real_from = from;
+    int i = 0;
+    if (is_stack_location(to)) {
+        real_to = "qword [" + real_to + "]";
+        ++i;
+    }
+    if (is_stack_location(from)) {
+        real_from = "qword [" + real_from + "]";
+        ++i;
+    }
+    if (i > 1 || (i == 1 && real_to != to && !is_direct_source_operand(from))) {
+        // we cannot have `mov <mem>, <mem>` or `mov <mem>, <imm64>` so we need
+        // to use two instructions, rax is never live across a mov
+        add_comment(from + " -> rax -> " + to);
+        add_instr_mov("rax", real_from);
+        real_from = "rax";
+    }
+    if (real_to == real_from) {
+        return;
+    }
+    m_asm_text.push_back(tab() + "mov " + real_to + ", " + real_from);
+}
+
+void Object::add_instr_cmp(const std::string& a, const std::string& b) {
+    std::string real_a = a;
+    std::string real_b = b;
+    if (is_stack_location(a)) {
+        real_a = "qword [" + real_a + "]";
+    }
+    if (is_stack_location(b)) {
+        real_b = "qword [" + real_b + "]";
+    }
+    add_instr("cmp " + real_a + ", " + real_b);
+}
+
+void Object::add_instr_test(const std::string& a) {
+    if (is_register(a)) {
+        add_instr("test " + a + ", " + a);
+    } else if (is_stack_location(a)) {
+        add_instr("cmp qword [" + a + "], 0");
+    } else {
+        add_instr_mov("rax", a);
+        add_instr("test rax, rax");
+    }
+}
+
+void Object::add_instr_cmp_imm(const std::string& reg, size_t value, const std::string& scratch) {
+    // cmp only takes a sign-extended 32 bit immediate
+    if (value > 0x7fffffff) {
+        add_instr_mov(scratch, std::to_string(value));
+        add_instr_cmp(reg, scratch);
+    } else {
+        add_instr_cmp(reg, std::to_string(value));
+    }
+}
+
+void Object::add_instr_sub_imm(const std::string& reg, size_t value, const std::string& scratch) {
+    if (value == 0) {
+        return;
+    }
+    if (value > 0x7fffffff) {
+        add_instr_mov(scratch, std::to_string(value));
+        add_instr_sub(reg, scratch);
+    } else {
+        add_instr_sub(reg, std::to_string(value));
+    }
+}
+
+// TODO: this needs to be a function that gets called by add and mov, since they're the same.
+void Object::add_instr_add(const std::string& to, const std::string& from) {
+    std::string real_to = to;
+    std::string real_from = from;
+    if (is_stack_location(to)) {
+        real_to = "qword [" + real_to + "]";
+    }
+    if (is_stack_location(from)) {
+        real_from = "qword [" + real_from + "]";
+    }
+    m_asm_text.push_back(tab() + "add " + real_to + ", " + real_from);
+}
+
+void Object::add_instr_sub(const std::string& a, const std::string& b) {
+    std::string real_a = a;
+    std::string real_b = b;
+    if (is_stack_location(a)) {
+        real_a = "qword [" + real_a + "]";
+    }
+    if (is_stack_location(b)) {
+        real_b = "qword [" + real_b + "]";
+    }
+    m_asm_text.push_back(tab() + "sub " + real_a + ", " + real_b);
+}
+
+void Object::add_instr_mul(const std::string& a, const std::string& b) {
+    std::string real_a = a;
+    std::string real_b = b;
+    if (is_stack_location(a)) {
+        real_a = "qword [" + real_a + "]";
+    }
+    if (is_stack_location(b)) {
+        real_b = "qword [" + real_b + "]";
+    }
+    m_asm_text.push_back(tab() + "imul " + real_a + ", " + real_b);
+}
+
+void Object::add_instr_lea(const std::string& to, const std::string& operation) {
+    m_asm_text.push_back(tab() + "lea " + to + ", " + operation);
+}
+
+void Object::add_instr_call(const std::string& label) {
+    m_asm_text.push_back(tab() + "call " + label);
+}
+
+void Object::add_push_callee_saved_registers() {
+}
+
+void Object::add_pop_callee_saved_registers() {
+}
+
+void Object::error(const std::string& what) {
+    lk::log::error() << "compiler: " << what << "\n";
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ASTParser.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+struct LibraryInterface;
+class ModuleCache;
+class Object;
+class PassManager;
+
+// The compiler without its command line: parsing sources and compiling them
+// and the modules they use into objects. The compiler and tools embedding it,
+// like compiler_bench, link it.
+
+struct Options {
+    // more than one builds an executable for each, see build_batch()
+    std::vector<std::string> sources {};
+    // a file listing more sources, one per line
+    std::string manifest {};
+    // also omit the frame pointer in functions that call other functions
+    bool omit_frame_pointer { false };
+    // all modules are compiled together, so calls into dependencies may rely
+    // on how their functions were compiled
+    bool whole_program { false };
+    // dump the AST, fill results with a marker value, emit debug info
+    bool debug { false };
+    bool time_passes { false };
+    // time and allocations per phase, as a table on stderr
+    bool time_report { false };
+    // the same as a Chrome trace, written to this file
+    std::string time_trace {};
+    // binary trace of compiler events, see Trace.h
+    std::string trace {};
+    // assemble into memory and run main, instead of going through nasm and ld
+    bool run { false };
+    // run main in the bytecode interpreter, without any native codegen
+    bool interpret { false };
+    // directory of a prebuilt standard library to link against
+    std::string stdlib {};
+    // directory to build the standard library archive into
+    std::string build_stdlib {};
+    // write a Makefile fragment listing every input of the executable
+    bool write_depfile { false };
+    // where to write it, "<executable>.d" if empty
+    std::string depfile {};
+    // calls a compile-time evaluation may make before it's given up on
+    size_t evaluation_limit { 100000 };
+    // build again whenever one of the files the build read changes
+    bool watch { false };
+    // threads compiling the functions of a module
+    size_t jobs { std::max(1u, std::thread::hardware_concurrency()) };
+};
+
+// part of the file names of the standard library archive and interface, and
+// bumped whenever the generated code or the interface changes incompatibly
+static constexpr const char* s_stdlib_version = "2";
+
+// the passes of every build, which the command line turns on and off
+PassManager& compiler_passes();
+// the interface of the prebuilt standard library units are compiled against,
+// if Options::stdlib is set
+LibraryInterface& standard_library();
+// parsed units and compiled modules a --daemon keeps between builds
+ModuleCache& module_cache();
+// the files builds read since the last call, which --watch waits on to
+// change, if Options::watch is set
+std::set<std::string> take_watched_files();
+// Called between the builds of a compile server or --watch, which keep
+// interning the identifiers of every version of the sources they see. Once
+// there are too many, drops the module cache so that the symbols can start
+// over.
+void reset_symbols_if_grown();
+
+std::string stdlib_file(const std::string& dir, const std::string& extension);
+// Leaves the file, and so its mtime, alone if it already has `contents`, so
+// that whatever is built from it isn't considered out of date.
+bool write_if_changed(const std::string& path, const std::string& contents, bool& out_changed);
+// whether `output` exists and is newer than all of `inputs`
+bool is_up_to_date(const std::string& output, const std::vector<std::string>& inputs);
+// runs `command` through the shell, returns its exit status
+int run_command(const std::string& command);
+
+// the object files of `obj` and its dependencies, without those in archives
+void add_objs_from_obj(const Object& obj, std::unordered_set<std::string>& objs);
+// every file `obj` and its dependencies were built from
+void add_inputs_from_obj(const Object& obj, std::set<std::string>& inputs, const Options& options);
+
+std::vector<Token> tokenize_source(std::string_view source);
+std::shared_ptr<AST::Unit> parse_source(const std::string& path, const Options& options);
+// compiles the module at `path` and those it uses, `standalone` if it's the
+// root of an executable
+std::shared_ptr<Object> compile_source_to_obj(const std::string& path, bool standalone, const Options& options);
+// compiles every module under std/ and the asm library into an archive, and
+// writes the interface units using them are compiled against
+bool build_stdlib(const std::string& dir, const Options& options);
+
+// compiles `unit` and the modules it uses to asm in memory, like --run does,
+// so without running nasm or ld, whatever `options.run` is. Used modules are
+// loaded relative to the working directory.
+bool compile_to_asm(const std::shared_ptr<AST::Unit>& unit, const std::string& path, const Options& options, std::string& out_asm);
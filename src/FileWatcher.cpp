@@ -0,0 +1,122 @@
+#include "FileWatcher.h"
+
+#include <lk/Logger.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+// how long to wait for more changes once one arrived
+constexpr int s_settle_ms = 30;
+// a file was written, moved into place, or deleted
+constexpr uint32_t s_event_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE;
+
+std::string absolute(const std::string& path) {
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    return ec ? path : absolute.lexically_normal().string();
+}
+
+}
+
+FileWatcher::FileWatcher()
+    : m_fd(::inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) {
+    if (m_fd < 0) {
+        lk::log::error() << "failed to start watching files: " << std::strerror(errno) << std::endl;
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool FileWatcher::watch(const std::set<std::string>& paths) {
+    std::set<std::string> files;
+    std::set<std::string> new_directories;
+    for (const auto& path : paths) {
+        auto file = absolute(path);
+        new_directories.insert(std::filesystem::path(file).parent_path().string());
+        files.insert(std::move(file));
+    }
+    // keeps the watches that are still needed, so their pending events stay
+    for (auto iter = m_directories.begin(); iter != m_directories.end();) {
+        if (new_directories.erase(iter->second) == 0) {
+            ::inotify_rm_watch(m_fd, iter->first);
+            iter = m_directories.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    for (const auto& directory : new_directories) {
+        int wd = ::inotify_add_watch(m_fd, directory.c_str(), s_event_mask);
+        if (wd < 0) {
+            lk::log::error() << "failed to watch \"" << directory << "\": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        m_directories[wd] = directory;
+    }
+    m_files = std::move(files);
+    return true;
+}
+
+bool FileWatcher::wait(std::set<std::string>& out_changed) {
+    out_changed.clear();
+    // blocks until a file changed, then until none did for a moment
+    int timeout = -1;
+    for (;;) {
+        pollfd pfd { m_fd, POLLIN, 0 };
+        int ready = ::poll(&pfd, 1, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            lk::log::error() << "failed to wait for changes: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (ready == 0) {
+            return true;
+        }
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            ssize_t size = ::read(m_fd, buffer, sizeof(buffer));
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size < 0 && errno == EAGAIN) {
+                break;
+            }
+            if (size <= 0) {
+                lk::log::error() << "failed to read changes: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            for (char* ptr = buffer; ptr < buffer + size;) {
+                auto* event = reinterpret_cast<inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    // events were dropped, any file may have changed
+                    out_changed.insert(m_files.begin(), m_files.end());
+                    continue;
+                }
+                auto directory = m_directories.find(event->wd);
+                if (directory == m_directories.end() || event->len == 0) {
+                    continue;
+                }
+                auto path = (std::filesystem::path(directory->second) / event->name).string();
+                if (m_files.contains(path)) {
+                    out_changed.insert(std::move(path));
+                }
+            }
+        }
+        if (!out_changed.empty()) {
+            timeout = s_settle_ms;
+        }
+    }
+}
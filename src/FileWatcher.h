@@ -0,0 +1,34 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// Waits for files to change, via inotify. The directories the files are in
+// are watched rather than the files themselves, so that a file an editor
+// replaces by renaming a new one over it is still noticed.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool is_valid() const { return m_fd >= 0; }
+
+    // Replaces the files waited for. Changes that happened since the last
+    // call to wait() to files that stay watched are still reported.
+    bool watch(const std::set<std::string>& paths);
+    // Blocks until at least one of the files changed, and returns the ones
+    // that did. Changes following each other closely, like an editor's save,
+    // are returned together.
+    bool wait(std::set<std::string>& out_changed);
+
+private:
+    int m_fd { -1 };
+    // watch descriptor -> directory
+    std::unordered_map<int, std::string> m_directories {};
+    // absolute paths
+    std::set<std::string> m_files {};
+};
@@ -0,0 +1,189 @@
+#include "JIT.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+JIT::~JIT() {
+    if (m_memory) {
+        munmap(m_memory, m_size);
+    }
+}
+
+bool JIT::add_module(const std::string& name, const std::string& asm_source) {
+    if (m_memory) {
+        lk::log::error() << "jit: can't add \"" << name << "\" after linking" << std::endl;
+        return false;
+    }
+    Assembler::Module module;
+    if (!m_assembler.assemble(asm_source, name, module)) {
+        return false;
+    }
+    m_modules.push_back(std::move(module));
+    return true;
+}
+
+bool JIT::link() {
+    if (m_memory) {
+        lk::log::error() << "jit: already linked" << std::endl;
+        return false;
+    }
+    const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+    // text, rodata and data of all modules each get their own pages, so they
+    // can be protected separately
+    size_t text_size = 0;
+    size_t rodata_size = 0;
+    size_t data_size = 0;
+    m_placements.clear();
+    for (const auto& module : m_modules) {
+        Placement placement;
+        placement.text = text_size;
+        text_size = align_up(text_size + module.text.size(), 16);
+        placement.rodata = rodata_size;
+        rodata_size = align_up(rodata_size + module.rodata.size(), 16);
+        placement.data = data_size;
+        data_size = align_up(data_size + module.data.size(), 16);
+        m_placements.push_back(placement);
+    }
+    size_t rodata_start = align_up(text_size, page_size);
+    size_t data_start = rodata_start + align_up(rodata_size, page_size);
+    m_size = std::max(data_start + align_up(data_size, page_size), page_size);
+    // jump tables address their entries with 32 bit absolute displacements, so
+    // everything has to live in the low 2GB
+    void* memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (memory == MAP_FAILED) {
+        lk::log::error() << "jit: mmap failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    m_memory = static_cast<uint8_t*>(memory);
+    auto base = reinterpret_cast<uintptr_t>(m_memory);
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        auto& placement = m_placements.at(i);
+        placement.text += base;
+        placement.rodata += base + rodata_start;
+        placement.data += base + data_start;
+        const auto& module = m_modules.at(i);
+        std::copy(module.text.begin(), module.text.end(), reinterpret_cast<uint8_t*>(placement.text));
+        std::copy(module.rodata.begin(), module.rodata.end(), reinterpret_cast<uint8_t*>(placement.rodata));
+        std::copy(module.data.begin(), module.data.end(), reinterpret_cast<uint8_t*>(placement.data));
+    }
+
+    m_globals.clear();
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        const auto& module = m_modules.at(i);
+        for (const auto& global : module.globals) {
+            auto symbol = module.symbols.find(global);
+            if (symbol == module.symbols.end()) {
+                lk::log::error() << "jit: " << module.name << ": global '" << global << "' is not defined" << std::endl;
+                return false;
+            }
+            if (m_globals.contains(global)) {
+                lk::log::error() << "jit: " << module.name << ": '" << global << "' is already defined by another module" << std::endl;
+                return false;
+            }
+            m_globals[global] = address_of(i, symbol->second.section, symbol->second.offset);
+        }
+    }
+
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        const auto& module = m_modules.at(i);
+        for (const auto& relocation : module.relocations) {
+            uintptr_t target;
+            // labels of the module itself shadow other modules' globals, like
+            // in an object file
+            if (auto local = module.symbols.find(relocation.symbol); local != module.symbols.end()) {
+                target = address_of(i, local->second.section, local->second.offset);
+            } else if (auto global = m_globals.find(relocation.symbol); global != m_globals.end()) {
+                target = global->second;
+            } else {
+                lk::log::error() << "jit: " << module.name << ": undefined symbol '" << relocation.symbol << "'" << std::endl;
+                return false;
+            }
+            auto place = address_of(i, relocation.section, relocation.offset);
+            int64_t value = int64_t(target) + relocation.addend;
+            size_t size = 4;
+            switch (relocation.kind) {
+            case Assembler::Relocation::Kind::Relative32:
+                value -= int64_t(place);
+                break;
+            case Assembler::Relocation::Kind::Absolute32:
+                break;
+            case Assembler::Relocation::Kind::Absolute64:
+                size = 8;
+                break;
+            }
+            if (size == 4 && (value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max())) {
+                lk::log::error() << "jit: " << module.name << ": relocation against '" << relocation.symbol << "' out of range" << std::endl;
+                return false;
+            }
+            std::memcpy(reinterpret_cast<void*>(place), &value, size);
+        }
+    }
+
+    if (mprotect(m_memory, rodata_start, PROT_READ | PROT_EXEC) != 0
+        || (data_start > rodata_start && mprotect(m_memory + rodata_start, data_start - rodata_start, PROT_READ) != 0)) {
+        lk::log::error() << "jit: mprotect failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void* JIT::symbol(const std::string& name) const {
+    auto iter = m_globals.find(name);
+    if (iter == m_globals.end()) {
+        return nullptr;
+    }
+    return reinterpret_cast<void*>(iter->second);
+}
+
+bool JIT::write_perf_map() const {
+    auto path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    std::ofstream file(path);
+    if (!file) {
+        lk::log::error() << "jit: failed to open \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < m_modules.size(); ++i) {
+        const auto& module = m_modules.at(i);
+        // generated ___<n> labels are jump targets inside of functions
+        std::vector<std::pair<size_t, std::string>> functions;
+        for (const auto& [name, symbol] : module.symbols) {
+            if (symbol.section == Assembler::Section::Text && !name.starts_with("___")) {
+                functions.emplace_back(symbol.offset, name);
+            }
+        }
+        std::sort(functions.begin(), functions.end());
+        for (size_t k = 0; k < functions.size(); ++k) {
+            size_t end = k + 1 < functions.size() ? functions.at(k + 1).first : module.text.size();
+            file << std::hex << m_placements.at(i).text + functions.at(k).first << " " << end - functions.at(k).first << std::dec << " " << functions.at(k).second << "\n";
+        }
+    }
+    return bool(file);
+}
+
+uintptr_t JIT::address_of(size_t module_index, Assembler::Section section, size_t offset) const {
+    const auto& placement = m_placements.at(module_index);
+    switch (section) {
+    case Assembler::Section::Text:
+        return placement.text + offset;
+    case Assembler::Section::Rodata:
+        return placement.rodata + offset;
+    case Assembler::Section::Data:
+        return placement.data + offset;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Assembler.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loads assembled modules into executable memory of this process, and
+// resolves the symbols between them.
+class JIT {
+public:
+    JIT() = default;
+    ~JIT();
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    bool add_module(const std::string& name, const std::string& asm_source);
+    // maps, relocates and protects all added modules. Only once, as the code
+    // can't move while pointers into it are out.
+    bool link();
+    // address of a global symbol after link(), or nullptr
+    void* symbol(const std::string& name) const;
+    // /tmp/perf-<pid>.map, so perf can symbolize the generated code
+    bool write_perf_map() const;
+
+private:
+    struct Placement {
+        uintptr_t text { 0 };
+        uintptr_t rodata { 0 };
+        uintptr_t data { 0 };
+    };
+
+    uintptr_t address_of(size_t module_index, Assembler::Section section, size_t offset) const;
+
+    Assembler m_assembler {};
+    std::vector<Assembler::Module> m_modules {};
+    std::vector<Placement> m_placements {};
+    std::unordered_map<std::string, uintptr_t> m_globals {};
+    uint8_t* m_memory { nullptr };
+    size_t m_size { 0 };
+};
@@ -0,0 +1,121 @@
+#include "LibraryInterface.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// The format is line based:
+//
+//     xc-library <version>
+//     module <path>
+//     use <path>
+//     global <name>
+//     pure <name>
+//     clobbers <name> <register>...
+//     source <size>
+//     <size bytes of source>
+//     end
+//
+// with one module block per module.
+
+const LibraryInterface::Module* LibraryInterface::find(const std::string& path) const {
+    auto iter = std::find_if(modules.begin(), modules.end(), [&](const Module& module) { return module.path == path; });
+    return iter != modules.end() ? &*iter : nullptr;
+}
+
+bool LibraryInterface::write(const std::string& file_path) const {
+    std::ofstream file(file_path, std::ios::binary);
+    file << "xc-library " << version << "\n";
+    for (const auto& module : modules) {
+        file << "module " << module.path << "\n";
+        for (const auto& use : module.uses) {
+            file << "use " << use << "\n";
+        }
+        for (const auto& global : module.globals) {
+            file << "global " << global << "\n";
+        }
+        for (const auto& pure_function : module.pure_functions) {
+            file << "pure " << pure_function << "\n";
+        }
+        for (const auto& [function, registers] : module.clobber_sets) {
+            file << "clobbers " << function;
+            for (const auto& reg : registers) {
+                file << " " << reg;
+            }
+            file << "\n";
+        }
+        file << "source " << module.source.size() << "\n"
+             << module.source << "\n";
+        file << "end\n";
+    }
+    if (!file) {
+        lk::log::error() << "failed to write \"" << file_path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LibraryInterface::read(const std::string& file_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        lk::log::error() << "failed to open \"" << file_path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    auto fail = [&](const std::string& what) {
+        lk::log::error() << file_path << ": " << what << std::endl;
+        return false;
+    };
+    std::string line;
+    if (!std::getline(file, line) || !line.starts_with("xc-library ")) {
+        return fail("not a library interface");
+    }
+    version = line.substr(std::strlen("xc-library "));
+    modules.clear();
+    Module* module = nullptr;
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "module") {
+            module = &modules.emplace_back();
+            words >> module->path;
+            continue;
+        }
+        if (!module) {
+            return fail("'" + keyword + "' outside of a module");
+        }
+        if (keyword == "use") {
+            words >> module->uses.emplace_back();
+        } else if (keyword == "global") {
+            words >> module->globals.emplace_back();
+        } else if (keyword == "pure") {
+            words >> module->pure_functions.emplace_back();
+        } else if (keyword == "clobbers") {
+            std::string function;
+            words >> function;
+            auto& registers = module->clobber_sets[function];
+            std::string reg;
+            while (words >> reg) {
+                registers.insert(reg);
+            }
+        } else if (keyword == "source") {
+            size_t size = 0;
+            words >> size;
+            module->source.resize(size);
+            file.read(module->source.data(), std::streamsize(size));
+            // the newline after the source
+            file.ignore();
+        } else if (keyword == "end") {
+            module = nullptr;
+        } else {
+            return fail("unknown entry '" + keyword + "'");
+        }
+    }
+    if (module) {
+        return fail("missing 'end' of module " + module->path);
+    }
+    return true;
+}
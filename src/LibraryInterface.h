@@ -0,0 +1,30 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// What the driver needs to know about the modules of a prebuilt library, so
+// that units using them can be compiled and linked against its archive
+// without compiling the modules again.
+struct LibraryInterface {
+    struct Module {
+        // as written in `use` declarations, e.g. "std/print"
+        std::string path;
+        std::vector<std::string> uses;
+        std::vector<std::string> globals;
+        std::vector<std::string> pure_functions;
+        std::map<std::string, std::set<std::string>> clobber_sets;
+        // only parsed when its pure functions are evaluated at compile time
+        std::string source;
+    };
+
+    std::string version;
+    std::vector<Module> modules;
+
+    const Module* find(const std::string& path) const;
+
+    bool write(const std::string& file_path) const;
+    bool read(const std::string& file_path);
+};
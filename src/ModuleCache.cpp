@@ -0,0 +1,115 @@
+#include "ModuleCache.h"
+
+bool ModuleCache::stamp(const std::string& path, Stamp& out) {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    out = { mtime, size };
+    return true;
+}
+
+std::string ModuleCache::absolute(const std::string& path) {
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    return ec ? path : absolute.lexically_normal().string();
+}
+
+void ModuleCache::clear() {
+    std::lock_guard lock(m_mutex);
+    m_units.clear();
+    m_libraries.clear();
+    m_objects.clear();
+}
+
+std::shared_ptr<AST::Unit> ModuleCache::find_unit(const std::string& path, const Stamp& stamp) const {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_units.find(absolute(path));
+    if (iter == m_units.end() || iter->second.stamp != stamp) {
+        return nullptr;
+    }
+    return iter->second.unit;
+}
+
+std::vector<ModuleCache::Segment> ModuleCache::find_segments(const std::string& path) const {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_units.find(absolute(path));
+    if (iter == m_units.end()) {
+        return {};
+    }
+    return iter->second.segments;
+}
+
+void ModuleCache::add_unit(const std::string& path, const Stamp& stamp, const std::shared_ptr<AST::Unit>& unit, std::vector<Segment> segments) {
+    std::lock_guard lock(m_mutex);
+    m_units[absolute(path)] = { stamp, unit, std::move(segments) };
+}
+
+const LibraryInterface* ModuleCache::find_library(const std::string& path, const Stamp& stamp) const {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_libraries.find(absolute(path));
+    if (iter == m_libraries.end() || iter->second.stamp != stamp) {
+        return nullptr;
+    }
+    return &iter->second.library;
+}
+
+void ModuleCache::add_library(const std::string& path, const Stamp& stamp, const LibraryInterface& library) {
+    std::lock_guard lock(m_mutex);
+    m_libraries[absolute(path)] = { stamp, library };
+}
+
+std::shared_ptr<Object> ModuleCache::find_object(const std::string& key) const {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_objects.find(key);
+    if (iter == m_objects.end()) {
+        return nullptr;
+    }
+    for (const auto& input : iter->second.inputs) {
+        Stamp stamp;
+        if (!ModuleCache::stamp(input.path, stamp) || stamp != input.stamp) {
+            return nullptr;
+        }
+    }
+    return iter->second.object;
+}
+
+std::shared_ptr<Object> ModuleCache::find_previous_object(const std::string& key) const {
+    std::lock_guard lock(m_mutex);
+    auto iter = m_objects.find(key);
+    return iter == m_objects.end() ? nullptr : iter->second.object;
+}
+
+void ModuleCache::add_object(const std::string& key, const std::shared_ptr<Object>& object, const std::vector<std::string>& inputs) {
+    std::lock_guard lock(m_mutex);
+    CompiledObject entry { object, {} };
+    for (const auto& path : inputs) {
+        Input input { absolute(path), {} };
+        // sources were stamped before they were read, see find_unit()
+        if (auto unit = m_units.find(input.path); unit != m_units.end()) {
+            input.stamp = unit->second.stamp;
+        } else if (!stamp(input.path, input.stamp)) {
+            // can't tell when it changes
+            return;
+        }
+        entry.inputs.push_back(std::move(input));
+    }
+    m_objects[key] = std::move(entry);
+}
+
+std::unique_lock<std::mutex> ModuleCache::lock_module(const std::string& path) {
+    std::unique_lock lock(m_mutex);
+    auto& module_mutex = m_module_locks[absolute(path)];
+    if (!module_mutex) {
+        module_mutex = std::make_unique<std::mutex>();
+    }
+    // the mutex stays where it is when the map grows
+    auto& mutex = *module_mutex;
+    lock.unlock();
+    return std::unique_lock(mutex);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "LibraryInterface.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AST {
+struct Unit;
+}
+class Object;
+
+// What a compile server keeps between builds: parsed units, library
+// interfaces and compiled modules, each for as long as the files it was made
+// from are unchanged. A file counts as unchanged while its mtime and size are.
+class ModuleCache {
+public:
+    struct Stamp {
+        std::filesystem::file_time_type mtime {};
+        uintmax_t size { 0 };
+
+        bool operator==(const Stamp&) const = default;
+    };
+    // false if `path` can't be stat'ed
+    static bool stamp(const std::string& path, Stamp& out);
+
+    // nothing is cached until this is called
+    void enable() { m_enabled = true; }
+    bool is_enabled() const { return m_enabled; }
+    // drops everything cached, but stays enabled
+    void clear();
+
+    // A top-level declaration as it was written, and what parsing it on its
+    // own gave, so that only the declarations that changed in an edited
+    // source have to be parsed again.
+    struct Segment {
+        // of the text, which has no line numbers in it
+        uint64_t fingerprint;
+        std::string text;
+        std::shared_ptr<AST::Unit> unit;
+    };
+
+    // `stamp` is taken before the file is read, so that a change while it's
+    // read makes the entry stale instead of hiding the change
+    std::shared_ptr<AST::Unit> find_unit(const std::string& path, const Stamp& stamp) const;
+    // the segments of the last parse of `path`, even if it's out of date
+    std::vector<Segment> find_segments(const std::string& path) const;
+    void add_unit(const std::string& path, const Stamp& stamp, const std::shared_ptr<AST::Unit>& unit, std::vector<Segment> segments = {});
+
+    const LibraryInterface* find_library(const std::string& path, const Stamp& stamp) const;
+    void add_library(const std::string& path, const Stamp& stamp, const LibraryInterface& library);
+
+    // `key` has to tell apart everything besides the inputs that changes what
+    // a module compiles to, like the options and the working directory. The
+    // object is only returned while none of `inputs` changed.
+    std::shared_ptr<Object> find_object(const std::string& key) const;
+    // the object last added with `key`, even if it's out of date, to reuse
+    // the code of functions that didn't change
+    std::shared_ptr<Object> find_previous_object(const std::string& key) const;
+    void add_object(const std::string& key, const std::shared_ptr<Object>& object, const std::vector<std::string>& inputs);
+
+    // held while the module at `path` is compiled, so that builds running in
+    // parallel compile a module they share once and don't write its files at
+    // the same time
+    std::unique_lock<std::mutex> lock_module(const std::string& path);
+
+private:
+    struct Unit {
+        Stamp stamp;
+        std::shared_ptr<AST::Unit> unit;
+        std::vector<Segment> segments;
+    };
+    struct Library {
+        Stamp stamp;
+        LibraryInterface library;
+    };
+    struct Input {
+        std::string path;
+        Stamp stamp;
+    };
+    struct CompiledObject {
+        std::shared_ptr<Object> object;
+        std::vector<Input> inputs;
+    };
+
+    static std::string absolute(const std::string& path);
+
+    bool m_enabled { false };
+    // parsing may happen on the threads compiling functions
+    mutable std::mutex m_mutex {};
+    // by absolute path
+    std::unordered_map<std::string, Unit> m_units {};
+    std::unordered_map<std::string, Library> m_libraries {};
+    std::unordered_map<std::string, CompiledObject> m_objects {};
+    std::unordered_map<std::string, std::unique_ptr<std::mutex>> m_module_locks {};
+};
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "ASTParser.h"
+#include "Driver.h"
+#include "LibraryInterface.h"
+#include "Symbols.h"
+#include "VM.h"
+#include "Type.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// an expression flattened into a binary tree, annotated with what's needed to
+// schedule its evaluation
+struct ExpressionNode {
+    enum class Kind {
+        Operand, // immediate, label or stack location, needs no code
+        Operation,
+        Call,
+    } kind;
+    std::string value; // the operand, or the operator of an operation
+    std::shared_ptr<ExpressionNode> left { nullptr };
+    std::shared_ptr<ExpressionNode> right { nullptr };
+    AST::FunctionCall* call { nullptr };
+    std::vector<std::shared_ptr<ExpressionNode>> arguments {};
+    // Sethi-Ullman number: registers needed to evaluate this into a register
+    size_t need { 0 };
+    bool has_call { false };
+    // value numbering: the shape is the expression as written, the key also
+    // includes which version of each variable is used. Both are empty if the
+    // value can't be reused, e.g. because it calls an impure function.
+    std::string shape {};
+    std::string key {};
+    bool reads_memory { false };
+};
+
+class Object {
+public:
+    Object(const std::shared_ptr<AST::Unit>& root, const Options& options);
+    // the codegen state for one function of `module`, so that the functions
+    // of a module can be compiled in parallel
+    Object(Object& module, const std::string& function_name);
+    // a module of a prebuilt library, which is linked from its archive
+    Object(const LibraryInterface::Module& module, const LibraryInterface& library, const std::string& archive, const Options& options);
+    bool compile(const std::string& original_filename, bool standalone);
+    // Keeps the code of every function once compiled, and takes that of
+    // `previous`, an earlier compile of the same module, for functions that
+    // are unchanged along with everything their code depends on.
+    void reuse_functions_from(std::shared_ptr<const Object> previous);
+
+    const std::vector<std::shared_ptr<Object>>& dependencies() const;
+    const std::string& obj_file() const;
+    const std::string& source_file() const;
+    const std::shared_ptr<AST::Unit>& unit() const;
+    bool is_prebuilt() const { return m_prebuilt; }
+    // the generated assembly, as written to the .asm file
+    const std::string& asm_source() const;
+    // files the assembly pulls in via %include, transitively
+    const std::set<std::string>& asm_includes() const;
+    const std::vector<std::string>& globals() const;
+    const std::vector<std::string>& pure_functions() const;
+    const std::set<std::string>* clobber_set(const std::string& function_name) const;
+    bool get_type_by_name(Type& out_type, const std::string& type_name) const;
+
+private:
+    // the object this function context belongs to, or itself
+    Object& module() { return m_module ? *m_module : *this; }
+    const Object& module() const { return m_module ? *m_module : *this; }
+
+    bool compile_unit(const std::shared_ptr<AST::Unit>&);
+    bool compile_function_decl(const std::shared_ptr<AST::FunctionDecl>&);
+    bool compile_body(const std::shared_ptr<AST::Body>&);
+    bool compile_statement(const std::shared_ptr<AST::Statement>&);
+    bool compile_if_statement(const AST::IfStatement*);
+    bool compile_branchless_if_statement(const std::string& cond_result, const AST::Assignment* then_assignment, const std::shared_ptr<ExpressionNode>& then_node, const AST::Assignment* else_assignment, const std::shared_ptr<ExpressionNode>& else_node);
+    bool compile_else_statement(const std::shared_ptr<AST::ElseStatement>& stmt);
+    bool compile_match_statement(const AST::MatchStatement*);
+    void add_match_bit_tests(const std::vector<std::pair<size_t, size_t>>& cases, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch);
+    void add_match_jump_table(const std::vector<std::pair<size_t, size_t>>& cases, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch);
+    void add_match_compare_tree(const std::vector<std::pair<size_t, size_t>>& cases, size_t begin, size_t end, const std::vector<std::string>& case_labels, const std::string& default_label, const std::string& scratch);
+    bool compile_variable_decl(const AST::VariableDecl*);
+    bool compile_assignment(const AST::Assignment*);
+    // with the value's expression tree already built
+    bool compile_assignment(const AST::Assignment*, const std::shared_ptr<ExpressionNode>&);
+    bool compile_str_assignment(const AST::Assignment*);
+    bool compile_expression(const std::shared_ptr<AST::Expression>&, std::string& out_result_reg);
+    bool compile_expression(const std::shared_ptr<ExpressionNode>&, std::string& out_result_reg);
+    bool compile_expression_node(const std::shared_ptr<ExpressionNode>&, const std::string& hint, std::string& out);
+    bool compile_operation(const std::string& op, const std::string& left, const std::string& right, const std::string& hint, std::string& out_reg);
+    bool compile_function_call(AST::FunctionCall*, std::string& out);
+    bool compile_call(const std::shared_ptr<ExpressionNode>&, std::string& out);
+    bool compile_use_decl(const std::shared_ptr<AST::UseDecl>& unit);
+    std::string function_context_key(const std::shared_ptr<AST::Unit>& unit, const std::vector<std::vector<size_t>>& callees, size_t index) const;
+    std::string dependencies_key() const;
+
+    std::shared_ptr<ExpressionNode> make_expression_node(const std::shared_ptr<AST::Expression>&);
+    std::shared_ptr<ExpressionNode> make_term_node(const std::shared_ptr<AST::Term>&);
+    std::shared_ptr<ExpressionNode> make_factor_node(const std::shared_ptr<AST::Factor>&);
+    std::shared_ptr<ExpressionNode> make_unary_node(const std::shared_ptr<AST::Unary>&);
+    std::shared_ptr<ExpressionNode> make_operation_node(const std::string& op, const std::shared_ptr<ExpressionNode>& left, const std::shared_ptr<ExpressionNode>& right);
+    bool make_argument_node(AST::FunctionCall*, size_t index, std::shared_ptr<ExpressionNode>& out, std::shared_ptr<ExpressionNode>& out_length);
+    bool make_str_nodes(const std::shared_ptr<AST::Expression>&, std::shared_ptr<ExpressionNode>& out_ptr, std::shared_ptr<ExpressionNode>& out_length);
+    std::string add_string_literal(const std::string& value, size_t& out_size);
+    // runs a pure function with constant arguments in the bytecode VM, so the
+    // call can be replaced by its result
+    bool evaluate_call(const ExpressionNode& node, uint64_t& out);
+    bool make_evaluator();
+
+    struct ValueState {
+        std::unordered_map<SymbolId, size_t> variable_versions;
+        size_t memory_epoch;
+    };
+    void count_value_shapes(const std::shared_ptr<AST::Body>&);
+    std::string count_value_shapes(const std::shared_ptr<AST::Expression>&);
+    std::string count_value_shapes(const std::shared_ptr<AST::Unary>&);
+    std::string count_value_shapes(AST::FunctionCall*);
+    bool lookup_value(const std::shared_ptr<ExpressionNode>&, std::string& out);
+    void remember_value(const std::shared_ptr<ExpressionNode>&, const std::string& location);
+    std::string value_key(const std::shared_ptr<ExpressionNode>&) const;
+    size_t variable_version(SymbolId symbol) const;
+    void invalidate_variable(SymbolId symbol);
+    void invalidate_memory();
+    void enter_value_scope();
+    void leave_value_scope();
+    ValueState save_value_state() const;
+    void restore_value_state(const ValueState&);
+    void merge_value_states(const ValueState& before, const std::vector<ValueState>& branches);
+    bool is_pure_function(const std::string& name) const;
+    bool reads_memory(const std::string& function_name) const;
+
+    void add_comment(const std::string& comment, bool do_indent = true);
+    void add_newline();
+    void add_label(const std::string& label);
+    void add_instr(const std::string& instr);
+    void add_instr_ret(const std::string& from);
+    void add_instr_mov(const std::string& to, const std::string& from);
+    void add_instr_cmp(const std::string& a, const std::string& b);
+    void add_instr_test(const std::string& a);
+    void add_instr_cmp_imm(const std::string& reg, size_t value, const std::string& scratch);
+    void add_instr_sub_imm(const std::string& reg, size_t value, const std::string& scratch);
+    void add_instr_add(const std::string& to, const std::string& from);
+    void add_instr_sub(const std::string& a, const std::string& b);
+    void add_instr_mul(const std::string& a, const std::string& b);
+    void add_instr_lea(const std::string& to, const std::string& operation);
+    void add_instr_call(const std::string& label);
+    void add_operation(const std::string& op, const std::string& to, const std::string& from);
+    void add_parallel_move(std::vector<std::pair<std::string, std::string>> moves);
+    void add_push_callee_saved_registers();
+    void add_pop_callee_saved_registers();
+
+    std::string tab() const { return "    "; }
+
+    void error(const std::string& what);
+
+    bool get_location_for_identifier(const AST::Identifier& id, std::string& out);
+    std::string generate_signature(const std::shared_ptr<AST::FunctionDecl>& func);
+    bool register_identifier(const AST::Identifier& id, Type type, std::string& out_location, const std::string& fixed_location = "", const std::string& fixed_length_location = "");
+    bool is_str_variable(const AST::Identifier& id) const;
+    bool is_str_argument(const std::string& function_name, size_t index) const;
+    size_t argument_slot_count(const std::string& function_name, size_t argument_count) const;
+    void enter_scope();
+    void leave_scope();
+    std::string allocate_variable_location(const Type& type);
+    void take_variable_register(const std::string& reg);
+    std::string incoming_argument_location(size_t index) const;
+    std::set<std::string> clobbered_by_call(const std::string& function_name) const;
+    size_t make_stack_ptr_for_size(size_t size);
+    std::string stack_location(size_t offset) const;
+    static bool is_stack_location(const std::string& location);
+    std::string generate_unique_label();
+
+    std::string allocate_temporary(const std::string& hint = "");
+    void free_temporary(const std::string& location);
+    bool is_temporary(const std::string& location) const;
+    size_t free_temporary_count() const;
+    void release_temporaries();
+    static bool is_temporary_register(const std::string& location);
+    static bool is_register(const std::string& location);
+    static bool is_direct_source_operand(const std::string& location);
+
+    // a copy, since a compile server keeps objects past their build
+    Options m_options;
+    // parsed on demand for prebuilt modules
+    mutable std::shared_ptr<AST::Unit> m_root { nullptr };
+    Object* m_module { nullptr };
+    bool m_prebuilt { false };
+    std::string m_prebuilt_source {};
+    // keeps labels of different functions apart, and is the function's name
+    // so that other functions moving doesn't change them
+    std::string m_label_prefix {};
+    size_t m_current_reg { 0 };
+    std::vector<std::string> m_asm_text;
+    std::vector<std::string> m_asm_data;
+    std::vector<std::string> m_asm_rodata;
+    // string literals, each defined once per function, see add_string_literal()
+    std::vector<std::string> m_asm_strings;
+    size_t m_current_stack_ptr { 0 };
+
+    std::vector<std::string> m_globals;
+    size_t m_unique_label_i { 0 };
+    std::vector<std::shared_ptr<Object>> m_dependencies {};
+    std::string m_obj_file;
+    std::string m_source_file;
+    std::string m_asm_source;
+    std::set<std::string> m_asm_includes {};
+
+    std::unordered_set<Type> m_types {};
+    struct Variable {
+        Type type;
+        std::string location;
+        // of a str, whose location holds the pointer
+        std::string length_location {};
+    };
+    // variables of the current function
+    ScopedSymbolTable<Variable> m_variables {};
+    std::vector<std::string> m_live_temporaries {};
+    // registers of m_temporary_registers not taken by variables
+    std::vector<std::string> m_available_temporaries {};
+    // set by allocate_temporary(), fails the function being compiled
+    bool m_out_of_temporaries { false };
+    // registers variables of the current function may live in
+    std::vector<std::string> m_variable_registers {};
+    std::set<std::string> m_clobbered_registers {};
+    std::unordered_map<std::string, std::set<std::string>> m_clobber_sets {};
+    size_t m_outgoing_args_size { 0 };
+    // the functions of this module and its dependencies, by name, for the
+    // types of their arguments
+    std::unordered_map<std::string, std::shared_ptr<AST::FunctionDecl>> m_function_decls {};
+
+    std::shared_ptr<AST::FunctionDecl> m_current_function { nullptr };
+    bool m_omit_frame_pointer { false };
+    std::vector<std::string> m_pure_globals {};
+    std::unordered_set<std::string> m_pure_functions {};
+    // label -> string literal as written, to pass literals to evaluated calls
+    std::unordered_map<std::string, std::string> m_string_literals {};
+    // string literal as written -> label, so each is defined once
+    std::unordered_map<std::string, std::string> m_string_literal_labels {};
+    // function contexts share the evaluator of their module
+    std::mutex m_evaluator_mutex {};
+    std::unique_ptr<VM::Program> m_evaluation_program { nullptr };
+    std::unique_ptr<VM::Interpreter> m_evaluator { nullptr };
+    bool m_evaluator_failed { false };
+    struct FunctionOutput {
+        std::vector<std::string> text;
+        std::vector<std::string> data;
+        std::vector<std::string> rodata;
+        std::vector<std::string> strings;
+    };
+    struct CompiledFunction {
+        FunctionOutput output;
+        std::set<std::string> clobber_set;
+    };
+    bool m_keep_functions { false };
+    // by what the code depends on, see compile_unit()
+    std::unordered_map<std::string, CompiledFunction> m_compiled_functions {};
+    // only set while compiling
+    std::shared_ptr<const Object> m_previous { nullptr };
+    // how often each shape of expression occurs in the current function
+    std::unordered_map<std::string, size_t> m_value_shape_counts {};
+    // key -> stack location for the values available in each nested scope
+    std::vector<std::unordered_map<std::string, std::string>> m_value_scopes {};
+    std::unordered_map<SymbolId, size_t> m_variable_versions {};
+    size_t m_memory_epoch { 0 };
+    size_t m_value_version_counter { 0 };
+
+    // asm/lib routines without side effects, and whether they read memory
+    static inline const std::unordered_map<std::string, bool> s_pure_builtins = {
+        { "deref", true },
+        { "deref8", true },
+        { "ref", false },
+    };
+    // a pointer and a length, passed in two argument registers
+    static inline const Type s_str_type { "str", 16 };
+    static inline const std::string m_arg_registers[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+    // all caller-saved, rax is kept free as scratch and for return values
+    static inline const std::string m_temporary_registers[] = { "r10", "r11", "r8", "r9", "rcx", "rdx", "rsi", "rdi" };
+    // variables only get a register if this many are left for temporaries
+    static constexpr size_t s_reserved_temporaries = 3;
+    static inline const std::set<std::string> s_caller_saved_registers = { "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11" };
+    // registers written by the asm/lib routines
+    static inline const std::unordered_map<std::string, std::set<std::string>> s_builtin_clobbers = {
+        { "deref", { "rax" } },
+        { "deref8", { "rax" } },
+        { "ref", { "rax" } },
+        { "std_syscall", { "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r10", "r11" } },
+    };
+};
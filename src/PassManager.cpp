@@ -0,0 +1,142 @@
+#include "PassManager.h"
+#include "TimeReport.h"
+#include "Trace.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+
+void PassManager::add(Pass pass) {
+    assert(!find(pass.name));
+    for (const auto& dependency : pass.dependencies) {
+        // keeps the passes in an order they can run in
+        assert(find(dependency));
+        (void)dependency;
+    }
+    m_passes.push_back(std::move(pass));
+}
+
+bool PassManager::set_level(const std::string& level) {
+    if (level == "s") {
+        m_level = 2;
+        m_for_size = true;
+    } else if (level == "0" || level == "1" || level == "2") {
+        m_level = level.front() - '0';
+        m_for_size = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool PassManager::set_enabled(const std::string& name, bool enabled) {
+    if (!find(name)) {
+        return false;
+    }
+    m_overrides[name] = enabled;
+    return true;
+}
+
+void PassManager::reset() {
+    m_level = 2;
+    m_for_size = false;
+    m_overrides.clear();
+    m_enabled.clear();
+    std::lock_guard lock(m_timings_mutex);
+    m_timings.clear();
+}
+
+bool PassManager::resolve() {
+    // passes that can't run because they, or something they depend on, were
+    // disabled explicitly
+    std::unordered_set<std::string> blocked;
+    for (const auto& pass : m_passes) {
+        auto override = m_overrides.find(pass.name);
+        bool is_blocked = override != m_overrides.end() && !override->second;
+        for (const auto& dependency : pass.dependencies) {
+            is_blocked = is_blocked || blocked.contains(dependency);
+        }
+        if (!is_blocked) {
+            continue;
+        }
+        if (override != m_overrides.end() && override->second) {
+            lk::log::error() << "pass '" << pass.name << "' was enabled, but depends on a disabled pass" << std::endl;
+            return false;
+        }
+        blocked.insert(pass.name);
+    }
+    m_enabled.clear();
+    // dependencies always come before the passes that need them, so going
+    // backwards sees every pass before its dependencies
+    for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass) {
+        if (blocked.contains(pass->name)) {
+            continue;
+        }
+        auto override = m_overrides.find(pass->name);
+        bool wanted = m_enabled.contains(pass->name);
+        if (override != m_overrides.end()) {
+            wanted = wanted || override->second;
+        } else {
+            wanted = wanted || (m_level >= pass->level && (!m_for_size || pass->for_size));
+        }
+        if (wanted) {
+            m_enabled.insert(pass->name);
+            m_enabled.insert(pass->dependencies.begin(), pass->dependencies.end());
+        }
+    }
+    return true;
+}
+
+bool PassManager::has_pass(const std::string& name) const {
+    return find(name) != nullptr;
+}
+
+bool PassManager::run(const std::string& name, const std::function<bool()>& fn) {
+    assert(find(name));
+    if (!is_enabled(name)) {
+        return true;
+    }
+    ScopedPhase phase(name);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = fn();
+    XC_TRACE(PassRun, Trace::string(name), ok);
+    // passes run on multiple threads when functions are compiled in parallel
+    std::lock_guard lock(m_timings_mutex);
+    auto& timing = m_timings[name];
+    timing.total += std::chrono::steady_clock::now() - start;
+    ++timing.runs;
+    return ok;
+}
+
+void PassManager::print_timings(std::ostream& os) const {
+    std::chrono::steady_clock::duration total {};
+    for (const auto& [name, timing] : m_timings) {
+        total += timing.total;
+    }
+    os << std::left << std::setw(20) << "pass" << std::right << std::setw(8) << "runs" << std::setw(12) << "ms" << std::setw(8) << "%" << "\n";
+    for (const auto& pass : m_passes) {
+        if (!is_enabled(pass.name)) {
+            continue;
+        }
+        os << std::left << std::setw(20) << pass.name << std::right;
+        auto timing = m_timings.find(pass.name);
+        if (timing == m_timings.end()) {
+            // transforms done as part of another pass aren't timed separately
+            os << std::setw(8) << "-" << std::setw(12) << "-" << std::setw(8) << "-" << "\n";
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(timing->second.total).count();
+        double percent = total.count() > 0 ? 100.0 * double(timing->second.total.count()) / double(total.count()) : 0.0;
+        os << std::setw(8) << timing->second.runs << std::setw(12) << std::fixed << std::setprecision(3) << ms << std::setw(8) << std::setprecision(1) << percent << "\n";
+    }
+}
+
+const Pass* PassManager::find(const std::string& name) const {
+    auto iter = std::find_if(m_passes.begin(), m_passes.end(), [&](const Pass& pass) { return pass.name == name; });
+    if (iter == m_passes.end()) {
+        return nullptr;
+    }
+    return &*iter;
+}
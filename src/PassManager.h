@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct Pass {
+    enum class Kind {
+        // computes information other passes use
+        Analysis,
+        // changes the generated code
+        Transform,
+    };
+
+    std::string name;
+    std::string description;
+    Kind kind { Kind::Transform };
+    // lowest -O level the pass is enabled at
+    int level { 1 };
+    // whether the pass is enabled at -Os
+    bool for_size { true };
+    // passes that have to be enabled, and run first, for this pass to work
+    std::vector<std::string> dependencies {};
+};
+
+class PassManager {
+public:
+    void add(Pass pass);
+
+    // "0", "1", "2" or "s"
+    bool set_level(const std::string& level);
+    // overrides the level for one pass, regardless of the order of options
+    bool set_enabled(const std::string& name, bool enabled);
+    // decides which passes are enabled, call after all options are set
+    bool resolve();
+    // back to -O2 without overrides, for the next build of a compile server.
+    // The registered passes stay.
+    void reset();
+
+    bool has_pass(const std::string& name) const;
+    bool is_enabled(const std::string& name) const { return m_enabled.contains(name); }
+    const std::vector<Pass>& passes() const { return m_passes; }
+
+    // runs `fn` as the pass `name` if it's enabled, timing it. Returns false if
+    // the pass failed. May be called from multiple threads.
+    bool run(const std::string& name, const std::function<bool()>& fn);
+
+    void print_timings(std::ostream& os) const;
+
+private:
+    struct Timing {
+        std::chrono::steady_clock::duration total {};
+        size_t runs { 0 };
+    };
+
+    const Pass* find(const std::string& name) const;
+
+    std::vector<Pass> m_passes {};
+    int m_level { 2 };
+    bool m_for_size { false };
+    std::unordered_map<std::string, bool> m_overrides {};
+    std::unordered_set<std::string> m_enabled {};
+    std::mutex m_timings_mutex {};
+    std::unordered_map<std::string, Timing> m_timings {};
+};
@@ -0,0 +1,393 @@
+#include "Server.h"
+
+#include "Trace.h"
+
+#include <lk/Logger.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A request is a Header, sent along with the client's stdout and stderr for
+// builds, followed by the payload: the working directory and the arguments,
+// each terminated by a NUL. The server answers with the exit code as int32_t.
+
+namespace {
+
+constexpr char s_magic[8] = { 'X', 'C', 'S', 'E', 'R', 'V', 'E', '1' };
+// arguments longer than this are surely not a build
+constexpr uint32_t s_max_payload_size = 1024 * 1024;
+// clients send their request right after connecting. One that doesn't would
+// hold up every build after it, as builds run one at a time.
+constexpr time_t s_request_timeout_seconds = 5;
+
+enum class Kind : uint32_t {
+    Build,
+    Stop,
+};
+
+struct Header {
+    char magic[8];
+    Kind kind;
+    uint32_t payload_size;
+};
+
+struct Request {
+    Kind kind;
+    std::string working_directory;
+    std::vector<std::string> args;
+    int stdout_fd { -1 };
+    int stderr_fd { -1 };
+};
+
+bool make_address(const std::string& path, sockaddr_un& out) {
+    out = {};
+    out.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(out.sun_path)) {
+        lk::log::error() << "socket path \"" << path << "\" is too long" << std::endl;
+        return false;
+    }
+    std::memcpy(out.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+int connect_to(const std::string& path) {
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+// whether the process on the other end of `fd` runs as the same user, as
+// anyone else could read our output or build as us
+bool is_same_user(int fd) {
+    ucred credentials {};
+    socklen_t size = sizeof(credentials);
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 && credentials.uid == ::getuid();
+}
+
+// creates `path` if it doesn't exist, and checks that nobody else can get at
+// what's in it, like a socket another user could replace
+bool make_private_directory(const std::string& path) {
+    if (::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+        lk::log::error() << "failed to create \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat status {};
+    if (::lstat(path.c_str(), &status) != 0 || !S_ISDIR(status.st_mode) || status.st_uid != ::getuid() || (status.st_mode & 077) != 0) {
+        lk::log::error() << "\"" << path << "\" has to be a directory only you can access" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* data, size_t size) {
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool send_request(int fd, Kind kind, const std::string& payload) {
+    Header header {};
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.kind = kind;
+    header.payload_size = uint32_t(payload.size());
+
+    iovec iov { &header, sizeof(header) };
+    msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] {};
+    if (kind == Kind::Build) {
+        int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+        return false;
+    }
+    // the descriptors went with the first byte
+    return write_all(fd, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - size_t(sent))
+        && write_all(fd, payload.data(), payload.size());
+}
+
+bool receive_request(int fd, Request& out) {
+    Header header {};
+    iovec iov { &header, sizeof(header) };
+    msghdr message {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] {};
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+            int fds[2];
+            std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+            out.stdout_fd = fds[0];
+            out.stderr_fd = fds[1];
+        }
+    }
+    if (!read_all(fd, reinterpret_cast<char*>(&header) + received, sizeof(header) - size_t(received))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.payload_size > s_max_payload_size) {
+        lk::log::error() << "ignoring a malformed request" << std::endl;
+        return false;
+    }
+    out.kind = header.kind;
+    if (out.kind == Kind::Build && out.stdout_fd < 0) {
+        lk::log::error() << "ignoring a build request without stdout and stderr" << std::endl;
+        return false;
+    }
+    std::string payload(header.payload_size, '\0');
+    if (!read_all(fd, payload.data(), payload.size())) {
+        return false;
+    }
+    size_t start = 0;
+    bool is_working_directory = true;
+    for (size_t end = payload.find('\0'); end != std::string::npos; end = payload.find('\0', start)) {
+        if (is_working_directory) {
+            out.working_directory = payload.substr(0, end);
+            is_working_directory = false;
+        } else {
+            out.args.push_back(payload.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+void flush_output() {
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+}
+
+// runs the build with the client's stdout and stderr in place of our own,
+// so that its messages and those of nasm and ld end up with the client
+int run_build(const Request& request, const std::function<int(const std::vector<std::string>& args)>& build) {
+    flush_output();
+    int saved_stdout = ::fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    int saved_stderr = ::fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    ::dup2(request.stdout_fd, STDOUT_FILENO);
+    ::dup2(request.stderr_fd, STDERR_FILENO);
+
+    int exit_code = 1;
+    if (::chdir(request.working_directory.c_str()) != 0) {
+        lk::log::error() << "failed to change to \"" << request.working_directory << "\": " << std::strerror(errno) << std::endl;
+    } else {
+        try {
+            exit_code = build(request.args);
+        } catch (const std::exception& e) {
+            // the server outlives a build that fails this way
+            lk::log::error() << "build failed: " << e.what() << std::endl;
+        }
+    }
+
+    flush_output();
+    ::dup2(saved_stdout, STDOUT_FILENO);
+    ::dup2(saved_stderr, STDERR_FILENO);
+    ::close(saved_stdout);
+    ::close(saved_stderr);
+    return exit_code;
+}
+
+}
+
+namespace Server {
+
+std::string default_socket_path() {
+    if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR"); runtime_dir && *runtime_dir) {
+        return (std::filesystem::path(runtime_dir) / "xc-compiler.sock").string();
+    }
+    return "/tmp/xc-compiler-" + std::to_string(::getuid()) + "/compiler.sock";
+}
+
+bool serve(const std::string& path, const std::function<int(const std::vector<std::string>& args)>& build) {
+    // builds change the working directory
+    std::error_code ec;
+    std::string socket_path = std::filesystem::absolute(path, ec).string();
+    if (ec) {
+        socket_path = path;
+    }
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        return false;
+    }
+    auto directory = std::filesystem::path(socket_path).parent_path().string();
+    if ((socket_path == default_socket_path() || !std::filesystem::exists(directory, ec)) && !make_private_directory(directory)) {
+        return false;
+    }
+    if (int fd = connect_to(socket_path); fd >= 0) {
+        ::close(fd);
+        lk::log::error() << "a compile server already listens on \"" << socket_path << "\"" << std::endl;
+        return false;
+    }
+    // left behind by a server that went away
+    ::unlink(socket_path.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0
+        || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::chmod(socket_path.c_str(), 0600) != 0
+        || ::listen(listener, 16) != 0) {
+        lk::log::error() << "failed to listen on \"" << socket_path << "\": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return false;
+    }
+    // a client going away mid-build mustn't take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+    XC_INFO("compile server listening on \"" << socket_path << "\"" << std::endl);
+
+    bool stopped = false;
+    while (!stopped) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            lk::log::error() << "failed to accept a client: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (!is_same_user(client)) {
+            lk::log::error() << "ignoring a client of another user" << std::endl;
+            ::close(client);
+            continue;
+        }
+        timeval timeout { .tv_sec = s_request_timeout_seconds, .tv_usec = 0 };
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        Request request;
+        errno = 0;
+        bool received = receive_request(client, request);
+        if (!received && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            lk::log::error() << "ignoring a client that sent no request in time" << std::endl;
+        }
+        if (received) {
+            int32_t exit_code = 0;
+            if (request.kind == Kind::Stop) {
+                stopped = true;
+            } else {
+                exit_code = run_build(request, build);
+            }
+            write_all(client, &exit_code, sizeof(exit_code));
+        }
+        for (int fd : { request.stdout_fd, request.stderr_fd }) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        ::close(client);
+    }
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    XC_INFO("compile server stopped" << std::endl);
+    return stopped;
+}
+
+static bool send(const std::string& socket_path, Kind kind, const std::vector<std::string>& args, int& out_exit_code) {
+    int fd = connect_to(socket_path);
+    if (fd < 0) {
+        lk::log::error() << "no compile server listens on \"" << socket_path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (!is_same_user(fd)) {
+        ::close(fd);
+        lk::log::error() << "the compile server on \"" << socket_path << "\" runs as another user" << std::endl;
+        return false;
+    }
+    std::error_code ec;
+    std::string payload = std::filesystem::current_path(ec).string();
+    payload += '\0';
+    for (const auto& arg : args) {
+        payload += arg;
+        payload += '\0';
+    }
+    int32_t exit_code = 0;
+    bool ok = send_request(fd, kind, payload) && read_all(fd, &exit_code, sizeof(exit_code));
+    ::close(fd);
+    if (!ok) {
+        lk::log::error() << "the compile server on \"" << socket_path << "\" went away" << std::endl;
+        return false;
+    }
+    out_exit_code = exit_code;
+    return true;
+}
+
+bool forward(const std::string& socket_path, const std::vector<std::string>& args, int& out_exit_code) {
+    return send(socket_path, Kind::Build, args, out_exit_code);
+}
+
+bool stop(const std::string& socket_path) {
+    int exit_code = 0;
+    return send(socket_path, Kind::Stop, {}, exit_code);
+}
+
+}
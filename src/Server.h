@@ -0,0 +1,29 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A compile server runs the builds clients forward to it over a Unix domain
+// socket, one at a time and in its own process, so that what it parsed and
+// compiled for one build is still there for the next. A build runs in the
+// client's working directory and writes to the client's stdout and stderr,
+// which are passed along with the request. Both ends only talk to processes
+// of the same user.
+namespace Server {
+
+// in $XDG_RUNTIME_DIR if set, in a directory of /tmp only the user can access
+// otherwise
+std::string default_socket_path();
+
+// Runs `build` with the arguments of every build forwarded to `socket_path`,
+// and sends its result back as the exit code. Returns once a client calls
+// stop(), or false if the socket can't be listened on.
+bool serve(const std::string& socket_path, const std::function<int(const std::vector<std::string>& args)>& build);
+
+// Runs a build with `args` on the server and waits for its exit code. Returns
+// false if no server listens on `socket_path`, or it went away.
+bool forward(const std::string& socket_path, const std::vector<std::string>& args, int& out_exit_code);
+bool stop(const std::string& socket_path);
+
+}
@@ -0,0 +1,47 @@
+#include "Symbols.h"
+
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+std::mutex s_mutex;
+// a deque never moves its elements, so the map can refer to them
+std::deque<std::string> s_names { "" };
+std::unordered_map<std::string_view, SymbolId> s_ids;
+
+}
+
+namespace Symbols {
+
+SymbolId intern(std::string_view name) {
+    std::lock_guard lock(s_mutex);
+    auto iter = s_ids.find(name);
+    if (iter != s_ids.end()) {
+        return iter->second;
+    }
+    auto id = SymbolId(s_names.size());
+    s_ids.emplace(s_names.emplace_back(name), id);
+    return id;
+}
+
+const std::string& name(SymbolId id) {
+    std::lock_guard lock(s_mutex);
+    assert(id < s_names.size());
+    return s_names[id];
+}
+
+SymbolId count() {
+    std::lock_guard lock(s_mutex);
+    return SymbolId(s_names.size());
+}
+
+void reset() {
+    std::lock_guard lock(s_mutex);
+    s_ids.clear();
+    s_names.assign(1, "");
+}
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Identifiers are interned once while lexing, so that later stages can compare
+// them and index tables by a dense id instead of hashing their names.
+using SymbolId = uint32_t;
+
+namespace Symbols {
+
+// 0 is never handed out, so it can mean "no symbol"
+constexpr SymbolId none = 0;
+
+// returns the id of `name`, adding it if it's new. Safe to call from multiple
+// threads.
+SymbolId intern(std::string_view name);
+const std::string& name(SymbolId id);
+// one more than the highest id handed out so far
+SymbolId count();
+// forgets every symbol, so ids start over. Nothing holding an id may be used
+// afterwards, like tokens, ASTs and what was compiled from them.
+void reset();
+
+}
+
+// Maps the symbols declared in nested scopes to their values. Lookups index an
+// array by symbol id, and leaving a scope brings back what its declarations
+// shadowed.
+template<typename T>
+class ScopedSymbolTable {
+public:
+    // drops all scopes, but keeps the memory for the next function
+    void clear() {
+        for (const auto& entry : m_entries) {
+            m_index[entry.symbol] = 0;
+        }
+        m_entries.clear();
+        m_scopes.clear();
+    }
+
+    void enter_scope() { m_scopes.push_back(m_entries.size()); }
+
+    void leave_scope() {
+        size_t begin = m_scopes.back();
+        m_scopes.pop_back();
+        while (m_entries.size() > begin) {
+            const auto& entry = m_entries.back();
+            m_index[entry.symbol] = entry.shadowed;
+            m_entries.pop_back();
+        }
+    }
+
+    // returns false if the symbol is already declared in the innermost scope
+    bool declare(SymbolId symbol, T value) {
+        if (symbol >= m_index.size()) {
+            m_index.resize(symbol + 1, 0);
+        }
+        uint32_t current = m_index[symbol];
+        if (current != 0 && (m_scopes.empty() || current > m_scopes.back())) {
+            return false;
+        }
+        m_entries.push_back(Entry { symbol, std::move(value), current });
+        m_index[symbol] = uint32_t(m_entries.size());
+        return true;
+    }
+
+    T* find(SymbolId symbol) {
+        if (symbol >= m_index.size() || m_index[symbol] == 0) {
+            return nullptr;
+        }
+        return &m_entries[m_index[symbol] - 1].value;
+    }
+
+    const T* find(SymbolId symbol) const {
+        return const_cast<ScopedSymbolTable*>(this)->find(symbol);
+    }
+
+    // calls `fn(symbol, value)` for each declaration of the innermost scope
+    template<typename Fn>
+    void for_each_in_scope(Fn fn) {
+        for (size_t i = m_scopes.empty() ? 0 : m_scopes.back(); i < m_entries.size(); ++i) {
+            fn(m_entries[i].symbol, m_entries[i].value);
+        }
+    }
+
+private:
+    struct Entry {
+        SymbolId symbol;
+        T value;
+        // index + 1 of the entry this one shadows, 0 if none
+        uint32_t shadowed;
+    };
+
+    // symbol -> index + 1 of its innermost entry, 0 if it's not declared
+    std::vector<uint32_t> m_index {};
+    std::vector<Entry> m_entries {};
+    // index of the first entry of each scope
+    std::vector<size_t> m_scopes {};
+};
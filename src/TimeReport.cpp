@@ -0,0 +1,193 @@
+#include "TimeReport.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include <sys/resource.h>
+
+namespace {
+
+thread_local std::vector<std::string> t_path;
+
+size_t thread_index() {
+    static std::atomic<size_t> s_next_index { 0 };
+    thread_local size_t t_index = s_next_index++;
+    return t_index;
+}
+
+std::string escape_json(const std::string& str) {
+    std::string escaped;
+    for (char c : str) {
+        switch (c) {
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                escaped += buffer;
+            } else {
+                escaped += c;
+            }
+        }
+    }
+    return escaped;
+}
+
+}
+
+TimeReport& TimeReport::the() {
+    static TimeReport s_report;
+    return s_report;
+}
+
+std::vector<std::string> TimeReport::current_path() {
+    return t_path;
+}
+
+void TimeReport::reset() {
+    std::lock_guard lock(m_mutex);
+    m_enabled = false;
+    m_start = std::chrono::steady_clock::now();
+    m_events.clear();
+}
+
+void TimeReport::record(Event&& event) {
+    std::lock_guard lock(m_mutex);
+    m_events.push_back(std::move(event));
+}
+
+void TimeReport::print_table(std::ostream& os) const {
+    struct Node {
+        std::string name;
+        std::chrono::steady_clock::duration total {};
+        size_t runs { 0 };
+        uint64_t allocations { 0 };
+        uint64_t allocated_bytes { 0 };
+        // in the order they first ran
+        std::vector<std::unique_ptr<Node>> children {};
+    };
+
+    std::lock_guard lock(m_mutex);
+    std::vector<const Event*> events;
+    for (const auto& event : m_events) {
+        events.push_back(&event);
+    }
+    std::sort(events.begin(), events.end(), [](const Event* a, const Event* b) { return a->start < b->start; });
+
+    Node root;
+    for (const auto* event : events) {
+        Node* node = &root;
+        for (const auto& name : event->path) {
+            auto iter = std::find_if(node->children.begin(), node->children.end(), [&](const auto& child) { return child->name == name; });
+            if (iter == node->children.end()) {
+                node->children.push_back(std::make_unique<Node>());
+                node->children.back()->name = name;
+                iter = node->children.end() - 1;
+            }
+            node = iter->get();
+        }
+        node->total += event->duration;
+        ++node->runs;
+        node->allocations += event->allocations;
+        node->allocated_bytes += event->allocated_bytes;
+    }
+
+    auto wall = std::chrono::steady_clock::now() - m_start;
+    os << std::right << std::setw(12) << "ms" << std::setw(8) << "%" << std::setw(8) << "runs" << std::setw(12) << "allocs" << std::setw(12) << "KiB"
+       << "  phase\n";
+    auto print = [&](auto& self, const Node& node, size_t depth) -> void {
+        double ms = std::chrono::duration<double, std::milli>(node.total).count();
+        double percent = wall.count() > 0 ? 100.0 * double(node.total.count()) / double(wall.count()) : 0.0;
+        os << std::setw(12) << std::fixed << std::setprecision(3) << ms << std::setw(8) << std::setprecision(1) << percent
+           << std::setw(8) << node.runs << std::setw(12) << node.allocations << std::setw(12) << node.allocated_bytes / 1024
+           << "  " << std::string(depth * 2, ' ') << node.name << "\n";
+        for (const auto& child : node.children) {
+            self(self, *child, depth + 1);
+        }
+    };
+    for (const auto& child : root.children) {
+        print(print, *child, 0);
+    }
+
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    os << "wall time: " << std::setprecision(3) << std::chrono::duration<double, std::milli>(wall).count() << " ms, peak RSS: " << usage.ru_maxrss << " KiB\n";
+}
+
+bool TimeReport::write_trace(const std::string& path) const {
+    std::ofstream file(path);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::lock_guard lock(m_mutex);
+    for (size_t i = 0; i < m_events.size(); ++i) {
+        const auto& event = m_events[i];
+        auto ts = std::chrono::duration_cast<std::chrono::microseconds>(event.start - m_start).count();
+        auto dur = std::chrono::duration_cast<std::chrono::microseconds>(event.duration).count();
+        file << (i == 0 ? "\n" : ",\n")
+             << "{\"name\":\"" << escape_json(event.path.back()) << "\",\"cat\":\"compile\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << ts << ",\"dur\":" << dur
+             << ",\"args\":{\"detail\":\"" << escape_json(event.detail) << "\",\"allocations\":" << event.allocations
+             << ",\"allocated_bytes\":" << event.allocated_bytes << "}}";
+    }
+    file << "\n]}\n";
+    if (!file) {
+        lk::log::error() << "failed to write \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ScopedPhase::ScopedPhase(const std::string& name, const std::string& detail) {
+    if (!TimeReport::the().is_enabled()) {
+        return;
+    }
+    m_active = true;
+    m_detail = detail;
+    t_path.push_back(name);
+    m_allocations = TimeReport::thread_allocations();
+    m_allocated_bytes = TimeReport::thread_allocated_bytes();
+    m_start = std::chrono::steady_clock::now();
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (!m_active) {
+        return;
+    }
+    auto duration = std::chrono::steady_clock::now() - m_start;
+    // before recording allocates
+    uint64_t allocations = TimeReport::thread_allocations() - m_allocations;
+    uint64_t allocated_bytes = TimeReport::thread_allocated_bytes() - m_allocated_bytes;
+    TimeReport::the().record({
+        .path = t_path,
+        .detail = std::move(m_detail),
+        .thread = thread_index(),
+        .start = m_start,
+        .duration = duration,
+        .allocations = allocations,
+        .allocated_bytes = allocated_bytes,
+    });
+    t_path.pop_back();
+}
+
+ScopedPhase::Adopt::Adopt(const std::vector<std::string>& path)
+    : m_previous(std::move(t_path)) {
+    t_path = path;
+}
+
+ScopedPhase::Adopt::~Adopt() {
+    t_path = std::move(m_previous);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Records how long each phase of a compilation takes and how much it
+// allocates, for -ftime-report and -ftime-trace. Phases nest per thread, and
+// a worker thread can continue the nesting of the thread that started it.
+class TimeReport {
+public:
+    static TimeReport& the();
+
+    // nothing is recorded until this is called
+    void enable() { m_enabled = true; }
+    bool is_enabled() const { return m_enabled; }
+    // forgets everything recorded and stops recording, so that each build of
+    // a compile server gets its own report
+    void reset();
+
+    // one table row per distinct nesting of phases, with the phases that ran
+    // inside it indented below
+    void print_table(std::ostream& os) const;
+    // Chrome's trace event format, for chrome://tracing or Perfetto
+    bool write_trace(const std::string& path) const;
+
+    // the phases the calling thread is in, outermost first
+    static std::vector<std::string> current_path();
+    // allocations the calling thread made so far, counted even when nothing
+    // is recorded, see TimeReportAllocations.cpp
+    static uint64_t thread_allocations();
+    static uint64_t thread_allocated_bytes();
+
+private:
+    friend class ScopedPhase;
+
+    struct Event {
+        std::vector<std::string> path;
+        std::string detail;
+        size_t thread;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::duration duration;
+        uint64_t allocations;
+        uint64_t allocated_bytes;
+    };
+
+    void record(Event&& event);
+
+    // read by ScopedPhase on any thread
+    std::atomic<bool> m_enabled { false };
+    std::chrono::steady_clock::time_point m_start { std::chrono::steady_clock::now() };
+    mutable std::mutex m_mutex {};
+    std::vector<Event> m_events {};
+};
+
+// Times everything until it goes out of scope as the phase `name`, nested in
+// the phases the thread already is in. `detail`, e.g. the function being
+// compiled, only shows up in the trace.
+class ScopedPhase {
+public:
+    ScopedPhase(const std::string& name, const std::string& detail = "");
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+    // makes the calling thread continue the nesting of another thread, as
+    // returned by TimeReport::current_path(), until it goes out of scope
+    class Adopt {
+    public:
+        explicit Adopt(const std::vector<std::string>& path);
+        ~Adopt();
+
+    private:
+        std::vector<std::string> m_previous;
+    };
+
+private:
+    bool m_active { false };
+    std::string m_detail;
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t m_allocations { 0 };
+    uint64_t m_allocated_bytes { 0 };
+};
@@ -0,0 +1,68 @@
+#include "TimeReport.h"
+
+#include <cstdlib>
+#include <new>
+
+// The replaced operator new and delete are kept apart from the rest of
+// TimeReport, so that GCC doesn't inline them into the standard containers
+// it uses and then warn about free() on memory from a `new` it can't see is
+// malloc().
+
+namespace {
+
+// per thread so that phases on other threads don't show up in each other's
+// numbers
+thread_local uint64_t t_allocations = 0;
+thread_local uint64_t t_allocated_bytes = 0;
+
+void* allocate(std::size_t size) {
+    ++t_allocations;
+    t_allocated_bytes += size;
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        if (void* ptr = std::malloc(size)) {
+            return ptr;
+        }
+        auto handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+uint64_t TimeReport::thread_allocations() {
+    return t_allocations;
+}
+
+uint64_t TimeReport::thread_allocated_bytes() {
+    return t_allocated_bytes;
+}
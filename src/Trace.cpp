@@ -0,0 +1,212 @@
+#include "Trace.h"
+
+#include <lk/Logger.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A trace file starts with the magic, followed by one Record per event and an
+// End record. After that comes the string table: for every string id below
+// the End record's `a`, its length as uint32_t and its characters.
+
+namespace {
+
+constexpr char s_magic[8] = { 'X', 'C', 'T', 'R', 'A', 'C', 'E', '1' };
+constexpr uint16_t s_end_event = 0xffff;
+
+struct Record {
+    uint64_t time_ns;
+    uint16_t event;
+    uint16_t thread;
+    uint32_t reserved;
+    uint64_t a;
+    uint64_t b;
+};
+static_assert(sizeof(Record) == 32);
+
+struct EventFormat {
+    const char* name;
+    const char* a;
+    bool a_is_string;
+    const char* b;
+    bool b_is_string;
+};
+
+// indexed by Trace::Event
+constexpr EventFormat s_formats[] = {
+    { "module-loaded", "path", true, "bytes", false },
+    { "unit-parsed", "tokens", false, "chunks", false },
+    { "identifier-declared", "name", true, "size", false },
+    { "function-compiled", "name", true, "asm-lines", false },
+    { "pass-run", "pass", true, "ok", false },
+    { "call-evaluated", "function", true, "value", false },
+    { "command-run", "command", true, "status", false },
+};
+
+FILE* s_file = nullptr;
+std::string s_path;
+std::chrono::steady_clock::time_point s_start;
+// of the current recording, indexed by string id
+std::mutex s_strings_mutex;
+std::vector<std::string> s_strings;
+std::unordered_map<std::string, uint64_t> s_string_ids;
+
+uint16_t thread_index() {
+    static std::atomic<uint16_t> s_next_index { 0 };
+    thread_local uint16_t t_index = s_next_index++;
+    return t_index;
+}
+
+}
+
+namespace Trace {
+
+bool parse_log_level(std::string_view name, int& out_level) {
+    constexpr std::pair<std::string_view, int> levels[] = {
+        { "error", XC_LOG_LEVEL_ERROR },
+        { "warning", XC_LOG_LEVEL_WARNING },
+        { "info", XC_LOG_LEVEL_INFO },
+        { "debug", XC_LOG_LEVEL_DEBUG },
+    };
+    for (const auto& [level_name, level] : levels) {
+        if (name == level_name) {
+            out_level = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool start_recording(const std::string& path) {
+    // a compile server records each build into its own file
+    if (!stop_recording()) {
+        return false;
+    }
+    s_file = std::fopen(path.c_str(), "wb");
+    if (!s_file) {
+        lk::log::error() << "failed to open \"" << path << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    s_path = path;
+    {
+        // ids of strings recorded before are no use in this file
+        std::lock_guard lock(s_strings_mutex);
+        s_strings.clear();
+        s_string_ids.clear();
+    }
+    std::fwrite(s_magic, sizeof(s_magic), 1, s_file);
+    s_start = std::chrono::steady_clock::now();
+    s_recording = true;
+    return true;
+}
+
+bool stop_recording() {
+    if (!s_file) {
+        return true;
+    }
+    s_recording = false;
+    std::vector<std::string> strings;
+    {
+        std::lock_guard lock(s_strings_mutex);
+        strings = std::exchange(s_strings, {});
+        s_string_ids.clear();
+    }
+    Record end {};
+    end.event = s_end_event;
+    end.a = strings.size();
+    std::fwrite(&end, sizeof(end), 1, s_file);
+    for (const auto& str : strings) {
+        auto size = uint32_t(str.size());
+        std::fwrite(&size, sizeof(size), 1, s_file);
+        std::fwrite(str.data(), 1, str.size(), s_file);
+    }
+    bool ok = !std::ferror(s_file);
+    ok = std::fclose(s_file) == 0 && ok;
+    s_file = nullptr;
+    if (!ok) {
+        lk::log::error() << "failed to write \"" << s_path << "\"" << std::endl;
+    }
+    return ok;
+}
+
+uint64_t string(std::string_view str) {
+    std::lock_guard lock(s_strings_mutex);
+    auto [iter, inserted] = s_string_ids.try_emplace(std::string(str), s_strings.size());
+    if (inserted) {
+        s_strings.emplace_back(str);
+    }
+    return iter->second;
+}
+
+void record(Event event, uint64_t a, uint64_t b) {
+    Record record {
+        .time_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start).count()),
+        .event = uint16_t(event),
+        .thread = thread_index(),
+        .reserved = 0,
+        .a = a,
+        .b = b,
+    };
+    // stdio locks the file, so records from different threads don't mix
+    std::fwrite(&record, sizeof(record), 1, s_file);
+}
+
+bool dump(const std::string& path, std::ostream& os) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(s_magic)];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, s_magic, sizeof(magic)) != 0) {
+        lk::log::error() << "\"" << path << "\" is not a trace" << std::endl;
+        return false;
+    }
+    std::vector<Record> records;
+    Record record;
+    while (file.read(reinterpret_cast<char*>(&record), sizeof(record)) && record.event != s_end_event) {
+        records.push_back(record);
+    }
+    if (!file) {
+        lk::log::error() << "\"" << path << "\" ends early, was the trace finished?" << std::endl;
+        return false;
+    }
+    std::vector<std::string> strings(record.a);
+    for (auto& str : strings) {
+        uint32_t size = 0;
+        file.read(reinterpret_cast<char*>(&size), sizeof(size));
+        str.resize(size);
+        file.read(str.data(), size);
+    }
+    if (!file) {
+        lk::log::error() << "\"" << path << "\" has a truncated string table" << std::endl;
+        return false;
+    }
+
+    auto print_argument = [&](const char* name, bool is_string, uint64_t value) {
+        os << " " << name << "=";
+        if (is_string) {
+            os << "\"" << (value < strings.size() ? strings[value] : "?") << "\"";
+        } else {
+            os << value;
+        }
+    };
+    for (const auto& event : records) {
+        os << std::setw(12) << std::fixed << std::setprecision(3) << double(event.time_ns) / 1000.0 << "us  [" << event.thread << "] ";
+        if (event.event >= std::size(s_formats)) {
+            os << "unknown event " << event.event << "\n";
+            continue;
+        }
+        const auto& format = s_formats[event.event];
+        os << format.name;
+        print_argument(format.a, format.a_is_string, event.a);
+        print_argument(format.b, format.b_is_string, event.b);
+        os << "\n";
+    }
+    return true;
+}
+
+}
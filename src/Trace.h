@@ -0,0 +1,110 @@
+#pragma once
+
+#include <lk/Logger.h>
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Log levels, most important first. Messages less important than
+// XC_LOG_LEVEL are compiled out, the rest are filtered by the level set at
+// runtime. Errors are always logged, through lk::log::error().
+#define XC_LOG_LEVEL_ERROR 0
+#define XC_LOG_LEVEL_WARNING 1
+#define XC_LOG_LEVEL_INFO 2
+#define XC_LOG_LEVEL_DEBUG 3
+
+#ifndef XC_LOG_LEVEL
+#    ifdef NDEBUG
+#        define XC_LOG_LEVEL XC_LOG_LEVEL_INFO
+#    else
+#        define XC_LOG_LEVEL XC_LOG_LEVEL_DEBUG
+#    endif
+#endif
+
+// Binary trace events are compiled in unless XC_TRACING is 0, which is the
+// default for release builds.
+#ifndef XC_TRACING
+#    ifdef NDEBUG
+#        define XC_TRACING 0
+#    else
+#        define XC_TRACING 1
+#    endif
+#endif
+
+// The message is only formatted if its level is enabled, so e.g.
+// `XC_DEBUG("tree: " << tree->to_string(1))` costs a branch when it isn't.
+#define XC_LOG(level, stream, ...)                                 \
+    do {                                                           \
+        if constexpr (XC_LOG_LEVEL >= XC_LOG_LEVEL_##level) {      \
+            if (Trace::is_log_enabled(XC_LOG_LEVEL_##level)) {     \
+                lk::log::stream() << __VA_ARGS__;                  \
+            }                                                      \
+        }                                                          \
+    } while (false)
+
+#define XC_WARNING(...) XC_LOG(WARNING, warning, __VA_ARGS__)
+#define XC_INFO(...) XC_LOG(INFO, info, __VA_ARGS__)
+#define XC_DEBUG(...) XC_LOG(DEBUG, debug, __VA_ARGS__)
+
+// Records `event` with two arguments in the binary trace. The arguments are
+// only evaluated while a trace is being written, and strings have to be
+// passed through Trace::string().
+#if XC_TRACING
+#    define XC_TRACE(event, a, b)                                                          \
+        do {                                                                               \
+            if (Trace::is_recording()) {                                                   \
+                Trace::record(Trace::Event::event, uint64_t(a), uint64_t(b));              \
+            }                                                                              \
+        } while (false)
+#else
+#    define XC_TRACE(event, a, b) \
+        do {                      \
+        } while (false)
+#endif
+
+namespace Trace {
+
+enum class Event : uint16_t {
+    // path, size in bytes
+    ModuleLoaded,
+    // tokens, chunks
+    UnitParsed,
+    // identifier, size of its type
+    IdentifierDeclared,
+    // function, lines of asm emitted
+    FunctionCompiled,
+    // pass, whether it succeeded
+    PassRun,
+    // function, value it evaluated to
+    CallEvaluated,
+    // command line, exit status
+    CommandRun,
+};
+
+// checked at every log and trace site, so they're inline
+inline std::atomic<int> s_log_level { XC_LOG_LEVEL_INFO };
+inline std::atomic<bool> s_recording { false };
+
+inline void set_log_level(int level) { s_log_level.store(level, std::memory_order_relaxed); }
+inline int log_level() { return s_log_level.load(std::memory_order_relaxed); }
+inline bool is_log_enabled(int level) { return level <= s_log_level.load(std::memory_order_relaxed); }
+// "error", "warning", "info" or "debug", returns false for anything else
+bool parse_log_level(std::string_view name, int& out_level);
+
+// starts writing the events recorded from now on to `path`
+bool start_recording(const std::string& path);
+// finishes the file, which is unreadable until this is called
+bool stop_recording();
+inline bool is_recording() { return s_recording.load(std::memory_order_relaxed); }
+void record(Event event, uint64_t a, uint64_t b);
+// strings are recorded as ids into a table of their own, which the trace
+// ends with and which starts out empty for each recording
+uint64_t string(std::string_view str);
+
+// prints a trace written by start_recording() as text
+bool dump(const std::string& path, std::ostream& os);
+
+}
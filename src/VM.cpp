@@ -0,0 +1,688 @@
+#include "VM.h"
+
+#include <lk/Logger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <unistd.h>
+
+#if defined(__GNUC__)
+#    define VM_COMPUTED_GOTO 1
+#endif
+
+namespace VM {
+
+static const std::unordered_map<std::string, Native> s_natives = {
+    { "deref", Native::Deref },
+    { "deref8", Native::Deref8 },
+    { "ref", Native::Ref },
+    { "std_syscall", Native::Syscall },
+};
+
+// registers of all active frames, 8MB like a default stack
+static constexpr size_t s_register_stack_size = 1024 * 1024;
+
+uint64_t Program::add_string(const std::string& literal, size_t& out_size) {
+    auto [index, inserted] = string_indices.try_emplace(literal, strings.size());
+    if (!inserted) {
+        out_size = strings.at(index->second).size();
+        return reinterpret_cast<uint64_t>(strings.at(index->second).c_str());
+    }
+    // same escapes as the native string literals
+    std::string str;
+    for (size_t i = 0; i < literal.size(); ++i) {
+        char c = literal[i];
+        if (c == '\\' && i + 1 < literal.size()) {
+            char escaped = literal[++i];
+            if (escaped == 'n') {
+                str += '\n';
+            } else if (escaped == '\\') {
+                str += '\\';
+            }
+        } else {
+            str += c;
+        }
+    }
+    // a deque never moves its elements, so the address stays valid
+    strings.push_back(std::move(str));
+    auto address = reinterpret_cast<uint64_t>(strings.back().c_str());
+    string_ranges.emplace(address, strings.back().size() + 1);
+    out_size = strings.back().size();
+    return address;
+}
+
+bool Program::is_string_address(uint64_t value, size_t size) const {
+    // the string starting last at or before `value`
+    auto iter = string_ranges.upper_bound(value);
+    if (iter == string_ranges.begin()) {
+        return false;
+    }
+    --iter;
+    return value + size <= iter->first + iter->second;
+}
+
+Compiler::Compiler(Loader loader)
+    : m_loader(std::move(loader)) {
+}
+
+bool Compiler::add_unit(const std::shared_ptr<AST::Unit>& unit) {
+    for (const auto& use_decl : unit->use_decls) {
+        if (!m_loaded_paths.insert(use_decl->path).second) {
+            continue;
+        }
+        auto dependency = m_loader(use_decl->path);
+        if (!dependency) {
+            return error("failed to load dependency \"" + use_decl->path + "\"");
+        }
+        if (!add_unit(dependency)) {
+            return false;
+        }
+    }
+    m_decls.insert(m_decls.end(), unit->decls.begin(), unit->decls.end());
+    return true;
+}
+
+bool Compiler::compile(Program& out) {
+    out = Program {};
+    m_program = &out;
+    // every function gets its index first, so calls can go to functions
+    // declared later
+    for (const auto& decl : m_decls) {
+        if (out.function_indices.contains(decl->name->name) || s_natives.contains(decl->name->name)) {
+            return error("function " + decl->name->name + "() is defined more than once");
+        }
+        out.function_indices[decl->name->name] = uint32_t(out.functions.size());
+        out.functions.emplace_back();
+    }
+    for (size_t i = 0; i < m_decls.size(); ++i) {
+        if (!compile_function(*m_decls.at(i), out.functions.at(i))) {
+            return false;
+        }
+    }
+    m_program = nullptr;
+    return true;
+}
+
+bool Compiler::compile_function(const AST::FunctionDecl& decl, Function& out) {
+    m_function = &out;
+    m_variables.clear();
+    m_variables.enter_scope();
+    m_locals_end = 0;
+    m_next_register = 0;
+    out.name = decl.name->name;
+    if (decl.arguments) {
+        for (const auto& arg : decl.arguments->variables) {
+            if (!declare_variable(*arg)) {
+                return false;
+            }
+        }
+        // a str argument is passed as two
+        out.argument_count = m_locals_end;
+    }
+    uint32_t result;
+    if (decl.result) {
+        if (decl.result->type_name->name == "str") {
+            return error("results are returned in one register, so " + decl.name->name + "() can't return a str");
+        }
+        if (!declare_variable(*decl.result)) {
+            return false;
+        }
+        result = m_variables.find(decl.result->identifier->symbol)->reg;
+    } else {
+        // functions without a result return a dummy register
+        result = allocate_register();
+        m_locals_end = m_next_register;
+    }
+    if (!compile_body(decl.body)) {
+        return false;
+    }
+    emit({ .op = Opcode::Return, .a = uint16_t(result) });
+    if (out.register_count > std::numeric_limits<uint16_t>::max()) {
+        return error("too many registers");
+    }
+    return true;
+}
+
+bool Compiler::declare_variable(const AST::VariableDecl& decl) {
+    if (std::find(typenames.begin(), typenames.end(), decl.type_name->name) == typenames.end()) {
+        return error("'" + decl.type_name->name + "' is not a known type");
+    }
+    m_next_register = m_locals_end;
+    Variable variable { allocate_register(), decl.type_name->name == "str" };
+    if (variable.is_str) {
+        allocate_register();
+    }
+    if (!m_variables.declare(decl.identifier->symbol, variable)) {
+        return error("'" + decl.identifier->name + "' is already declared in this scope");
+    }
+    m_locals_end = m_next_register;
+    return true;
+}
+
+bool Compiler::is_str_argument(uint32_t function_index, size_t index) const {
+    const auto& arguments = m_decls.at(function_index)->arguments;
+    return arguments && index < arguments->variables.size() && arguments->variables.at(index)->type_name->name == "str";
+}
+
+bool Compiler::compile_body(const std::shared_ptr<AST::Body>& body) {
+    m_variables.enter_scope();
+    for (const auto& stmt : body->statements->statements) {
+        if (!compile_statement(stmt)) {
+            return false;
+        }
+    }
+    m_variables.leave_scope();
+    return true;
+}
+
+bool Compiler::compile_statement(const std::shared_ptr<AST::Statement>& stmt) {
+    // no temporaries live across statements
+    m_next_register = m_locals_end;
+    if (auto assignment = dynamic_cast<AST::Assignment*>(stmt->statement.get())) {
+        auto variable = m_variables.find(assignment->identifier->symbol);
+        if (!variable) {
+            return error("'" + assignment->identifier->name + "' is not declared");
+        }
+        uint32_t value;
+        if (variable->is_str) {
+            if (!compile_str(assignment->expression, value)) {
+                return false;
+            }
+            if (value != variable->reg) {
+                emit({ .op = Opcode::Move, .a = uint16_t(variable->reg), .b = value });
+                emit({ .op = Opcode::Move, .a = uint16_t(variable->reg + 1), .b = value + 1 });
+            }
+            return true;
+        }
+        if (!compile_expression(assignment->expression, value)) {
+            return false;
+        }
+        if (value != variable->reg) {
+            emit({ .op = Opcode::Move, .a = uint16_t(variable->reg), .b = value });
+        }
+        return true;
+    }
+    if (auto fncall = dynamic_cast<AST::FunctionCall*>(stmt->statement.get())) {
+        uint32_t ignored_result;
+        return compile_call(*fncall, ignored_result);
+    }
+    if (auto decl = dynamic_cast<AST::VariableDecl*>(stmt->statement.get())) {
+        return declare_variable(*decl);
+    }
+    if (auto if_stmt = dynamic_cast<AST::IfStatement*>(stmt->statement.get())) {
+        return compile_if_statement(*if_stmt);
+    }
+    if (auto match_stmt = dynamic_cast<AST::MatchStatement*>(stmt->statement.get())) {
+        return compile_match_statement(*match_stmt);
+    }
+    return error("statement is not assignment, function call, if or match statement, but should be.");
+}
+
+bool Compiler::compile_if_statement(const AST::IfStatement& stmt) {
+    uint32_t condition;
+    if (!compile_expression(stmt.condition, condition)) {
+        return false;
+    }
+    auto jump_to_else = emit({ .op = Opcode::JumpIfZero, .a = uint16_t(condition) });
+    if (!compile_body(stmt.body)) {
+        return false;
+    }
+    if (!stmt.else_statement) {
+        m_function->code.at(jump_to_else).b = uint32_t(m_function->code.size());
+        return true;
+    }
+    auto jump_to_end = emit({ .op = Opcode::Jump });
+    m_function->code.at(jump_to_else).b = uint32_t(m_function->code.size());
+    if (!compile_body(stmt.else_statement->body)) {
+        return false;
+    }
+    m_function->code.at(jump_to_end).b = uint32_t(m_function->code.size());
+    return true;
+}
+
+bool Compiler::compile_match_statement(const AST::MatchStatement& stmt) {
+    uint32_t condition;
+    if (!compile_expression(stmt.condition, condition)) {
+        return false;
+    }
+    uint32_t table_index = uint32_t(m_function->match_tables.size());
+    m_function->match_tables.emplace_back();
+    emit({ .op = Opcode::Match, .a = uint16_t(condition), .b = table_index });
+    MatchTable table;
+    std::vector<size_t> jumps_to_end;
+    for (const auto& match_case : stmt.cases) {
+        for (auto value : match_case->values) {
+            table.cases.emplace_back(value, uint32_t(m_function->code.size()));
+        }
+        if (!compile_body(match_case->body)) {
+            return false;
+        }
+        jumps_to_end.push_back(emit({ .op = Opcode::Jump }));
+    }
+    table.default_target = uint32_t(m_function->code.size());
+    if (stmt.else_statement && !compile_body(stmt.else_statement->body)) {
+        return false;
+    }
+    for (auto jump : jumps_to_end) {
+        m_function->code.at(jump).b = uint32_t(m_function->code.size());
+    }
+    std::sort(table.cases.begin(), table.cases.end());
+    for (size_t i = 1; i < table.cases.size(); ++i) {
+        if (table.cases.at(i).first == table.cases.at(i - 1).first) {
+            return error("duplicate case " + std::to_string(table.cases.at(i).first) + " in match-statement");
+        }
+    }
+    m_function->match_tables.at(table_index) = std::move(table);
+    return true;
+}
+
+bool Compiler::compile_expression(const std::shared_ptr<AST::Expression>& expr, uint32_t& out) {
+    return compile_term(expr->term, out);
+}
+
+bool Compiler::compile_term(const std::shared_ptr<AST::Term>& term, uint32_t& out) {
+    if (!compile_factor(term->factors.at(0), out)) {
+        return false;
+    }
+    for (size_t i = 1; i < term->factors.size(); ++i) {
+        uint32_t right;
+        if (!compile_factor(term->factors.at(i), right)) {
+            return false;
+        }
+        auto op = term->operators.at(i - 1) == "+" ? Opcode::Add : Opcode::Subtract;
+        auto result = allocate_register();
+        emit({ .op = op, .a = uint16_t(result), .b = out, .c = right });
+        out = result;
+    }
+    return true;
+}
+
+bool Compiler::compile_factor(const std::shared_ptr<AST::Factor>& factor, uint32_t& out) {
+    if (!compile_unary(factor->unaries.at(0), out)) {
+        return false;
+    }
+    for (size_t i = 1; i < factor->unaries.size(); ++i) {
+        // same as native codegen, so both can be checked against each other
+        if (factor->operators.at(i - 1) == "/") {
+            return error("operator '/' is not implemented");
+        }
+        uint32_t right;
+        if (!compile_unary(factor->unaries.at(i), right)) {
+            return false;
+        }
+        auto result = allocate_register();
+        emit({ .op = Opcode::Multiply, .a = uint16_t(result), .b = out, .c = right });
+        out = result;
+    }
+    return true;
+}
+
+bool Compiler::compile_unary(const std::shared_ptr<AST::Unary>& unary, uint32_t& out) {
+    if (!unary->op.empty()) {
+        return error("unary operator '" + unary->op + "' is not implemented");
+    }
+    auto primary = dynamic_cast<AST::Primary*>(unary->unary_or_primary.get());
+    if (!primary) {
+        return error("expected a primary expression");
+    }
+    if (auto grouped_expression = dynamic_cast<AST::GroupedExpression*>(primary->value.get())) {
+        return compile_expression(grouped_expression->expression, out);
+    }
+    if (auto fncall = dynamic_cast<AST::FunctionCall*>(primary->value.get())) {
+        const auto& name = fncall->name->name;
+        if (std::find(str_builtins.begin(), str_builtins.end(), name) == str_builtins.end()) {
+            return compile_call(*fncall, out);
+        }
+        if (fncall->arguments.size() != 1) {
+            return error(name + "() takes one str");
+        }
+        if (!compile_str(fncall->arguments.front(), out)) {
+            return false;
+        }
+        if (name == "str_len") {
+            ++out;
+        }
+        return true;
+    }
+    if (auto identifier = dynamic_cast<AST::Identifier*>(primary->value.get())) {
+        auto variable = m_variables.find(identifier->symbol);
+        if (!variable) {
+            return error("'" + identifier->name + "' is not declared");
+        }
+        if (variable->is_str) {
+            return error("'" + identifier->name + "' is a str, which only str_ptr() and str_len() take apart");
+        }
+        out = variable->reg;
+        return true;
+    }
+    uint64_t value;
+    if (auto numeric_literal = dynamic_cast<AST::NumericLiteral*>(primary->value.get())) {
+        value = numeric_literal->value;
+    } else if (auto string_literal = dynamic_cast<AST::StringLiteral*>(primary->value.get())) {
+        size_t size;
+        value = m_program->add_string(string_literal->value, size);
+    } else {
+        return error("unexpected primary expression");
+    }
+    out = allocate_register();
+    emit({ .op = Opcode::LoadConstant, .a = uint16_t(out), .b = add_constant(value) });
+    return true;
+}
+
+bool Compiler::compile_call(const AST::FunctionCall& call, uint32_t& out) {
+    const auto& name = call.name->name;
+    auto native = s_natives.find(name);
+    auto function = m_program->function_indices.find(name);
+    if (native == s_natives.end() && function == m_program->function_indices.end()) {
+        return error("call to unknown function " + name + "()");
+    }
+    if (call.arguments.size() > std::numeric_limits<uint8_t>::max()) {
+        return error("too many arguments in call to " + name + "()");
+    }
+    if (function != m_program->function_indices.end() && m_decls.at(function->second)->arguments) {
+        auto expected = m_decls.at(function->second)->arguments->variables.size();
+        if (call.arguments.size() != expected) {
+            return error(name + "() takes " + std::to_string(expected) + " arguments, but " + std::to_string(call.arguments.size()) + " were given");
+        }
+    }
+    // arguments go into consecutive registers, which become the callee's first
+    // registers. A str argument takes two.
+    auto is_str = [&](size_t i) {
+        return function != m_program->function_indices.end() && is_str_argument(function->second, i);
+    };
+    size_t slot_count = 0;
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        slot_count += is_str(i) ? 2 : 1;
+    }
+    if (slot_count > std::numeric_limits<uint8_t>::max()) {
+        return error("too many arguments in call to " + name + "()");
+    }
+    uint32_t first = m_next_register;
+    for (size_t i = 0; i < std::max<size_t>(slot_count, 1); ++i) {
+        allocate_register();
+    }
+    uint32_t slot = first;
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        uint32_t value;
+        if (is_str(i)) {
+            if (!compile_str(call.arguments.at(i), value)) {
+                return false;
+            }
+            if (value != slot) {
+                emit({ .op = Opcode::Move, .a = uint16_t(slot), .b = value });
+                emit({ .op = Opcode::Move, .a = uint16_t(slot + 1), .b = value + 1 });
+            }
+            slot += 2;
+        } else {
+            if (!compile_expression(call.arguments.at(i), value)) {
+                return false;
+            }
+            if (value != slot) {
+                emit({ .op = Opcode::Move, .a = uint16_t(slot), .b = value });
+            }
+            slot += 1;
+        }
+        // temporaries of one argument aren't needed for the next
+        m_next_register = first + uint32_t(std::max<size_t>(slot_count, 1));
+    }
+    out = first;
+    if (native != s_natives.end()) {
+        emit({ .op = Opcode::CallNative, .argument_count = uint8_t(slot_count), .a = uint16_t(out), .b = uint32_t(native->second), .c = first });
+    } else {
+        emit({ .op = Opcode::Call, .argument_count = uint8_t(slot_count), .a = uint16_t(out), .b = function->second, .c = first });
+    }
+    m_next_register = first + 1;
+    return true;
+}
+
+// A str is a string literal or a str variable. `out` is the register of the
+// pointer, and the length is in the one after it.
+bool Compiler::compile_str(const std::shared_ptr<AST::Expression>& expr, uint32_t& out) {
+    auto value = expr->primary_value();
+    if (auto string_literal = dynamic_cast<AST::StringLiteral*>(value)) {
+        out = allocate_register();
+        allocate_register();
+        size_t size;
+        auto address = m_program->add_string(string_literal->value, size);
+        emit({ .op = Opcode::LoadConstant, .a = uint16_t(out), .b = add_constant(address) });
+        emit({ .op = Opcode::LoadConstant, .a = uint16_t(out + 1), .b = add_constant(size) });
+        return true;
+    }
+    if (auto identifier = dynamic_cast<AST::Identifier*>(value)) {
+        auto variable = m_variables.find(identifier->symbol);
+        if (variable && variable->is_str) {
+            out = variable->reg;
+            return true;
+        }
+    }
+    return error("expected a string literal or a str variable");
+}
+
+uint32_t Compiler::allocate_register() {
+    uint32_t reg = m_next_register++;
+    m_function->register_count = std::max<size_t>(m_function->register_count, m_next_register);
+    return reg;
+}
+
+uint32_t Compiler::add_constant(uint64_t value) {
+    auto iter = std::find(m_function->constants.begin(), m_function->constants.end(), value);
+    if (iter != m_function->constants.end()) {
+        return uint32_t(iter - m_function->constants.begin());
+    }
+    m_function->constants.push_back(value);
+    return uint32_t(m_function->constants.size() - 1);
+}
+
+size_t Compiler::emit(Instruction instruction) {
+    m_function->code.push_back(instruction);
+    return m_function->code.size() - 1;
+}
+
+bool Compiler::error(const std::string& what) {
+    lk::log::error() << "vm: " << (m_function ? m_function->name + ": " : "") << what << std::endl;
+    return false;
+}
+
+Interpreter::Interpreter(const Program& program)
+    : m_program(program) {
+}
+
+bool Interpreter::call(const std::string& name, const std::vector<uint64_t>& arguments, uint64_t& result) {
+    auto function = m_program.function_indices.find(name);
+    if (function == m_program.function_indices.end()) {
+        return error("no function " + name + "()");
+    }
+    if (arguments.size() != m_program.functions.at(function->second).argument_count) {
+        return error("wrong number of arguments for " + name + "()");
+    }
+    return run(function->second, arguments, result);
+}
+
+bool Interpreter::run(uint32_t function_index, const std::vector<uint64_t>& arguments, uint64_t& result) {
+    struct Frame {
+        const Function* function;
+        const Instruction* return_ip;
+        size_t base;
+        uint16_t result_register;
+    };
+    std::vector<Frame> frames;
+    if (m_registers.empty()) {
+        m_registers.resize(s_register_stack_size);
+    }
+    size_t calls = 0;
+    const Function* function = &m_program.functions.at(function_index);
+    if (function->register_count > m_registers.size()) {
+        return error("stack overflow");
+    }
+    size_t base = 0;
+    uint64_t* regs = m_registers.data();
+    std::fill(regs, regs + function->register_count, 0);
+    std::copy(arguments.begin(), arguments.end(), regs);
+    const uint64_t* constants = function->constants.data();
+    const Instruction* ip = function->code.data();
+
+#ifdef VM_COMPUTED_GOTO
+    // threaded code: every handler jumps straight to the next one
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wpedantic"
+    static const void* const s_dispatch_table[] = {
+        &&op_LoadConstant,
+        &&op_Move,
+        &&op_Add,
+        &&op_Subtract,
+        &&op_Multiply,
+        &&op_Jump,
+        &&op_JumpIfZero,
+        &&op_Match,
+        &&op_Call,
+        &&op_CallNative,
+        &&op_Return,
+    };
+#    define DISPATCH() goto* s_dispatch_table[size_t(ip->op)]
+#    define CASE(name)   \
+        case Opcode::name: \
+        op_##name
+#else
+#    define DISPATCH() continue
+#    define CASE(name) case Opcode::name
+#endif
+
+    for (;;) {
+        switch (ip->op) {
+            CASE(LoadConstant) : {
+                regs[ip->a] = constants[ip->b];
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Move) : {
+                regs[ip->a] = regs[ip->b];
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Add) : {
+                regs[ip->a] = regs[ip->b] + regs[ip->c];
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Subtract) : {
+                regs[ip->a] = regs[ip->b] - regs[ip->c];
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Multiply) : {
+                regs[ip->a] = regs[ip->b] * regs[ip->c];
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Jump) : {
+                ip = function->code.data() + ip->b;
+                DISPATCH();
+            }
+            CASE(JumpIfZero) : {
+                ip = regs[ip->a] == 0 ? function->code.data() + ip->b : ip + 1;
+                DISPATCH();
+            }
+            CASE(Match) : {
+                const auto& table = function->match_tables[ip->b];
+                auto value = regs[ip->a];
+                auto iter = std::lower_bound(table.cases.begin(), table.cases.end(), value, [](const auto& entry, uint64_t v) { return entry.first < v; });
+                auto target = iter != table.cases.end() && iter->first == value ? iter->second : table.default_target;
+                ip = function->code.data() + target;
+                DISPATCH();
+            }
+            CASE(Call) : {
+                const Function* callee = &m_program.functions[ip->b];
+                size_t callee_base = base + function->register_count;
+                if (callee_base + callee->register_count > m_registers.size()) {
+                    return error("stack overflow in " + callee->name + "()");
+                }
+                if (m_call_limit != 0 && ++calls > m_call_limit) {
+                    return error("call limit of " + std::to_string(m_call_limit) + " exceeded");
+                }
+                uint64_t* callee_regs = m_registers.data() + callee_base;
+                std::copy(regs + ip->c, regs + ip->c + ip->argument_count, callee_regs);
+                std::fill(callee_regs + ip->argument_count, callee_regs + callee->register_count, 0);
+                frames.push_back({ function, ip + 1, base, ip->a });
+                function = callee;
+                base = callee_base;
+                regs = callee_regs;
+                constants = function->constants.data();
+                ip = function->code.data();
+                DISPATCH();
+            }
+            CASE(CallNative) : {
+                if (!call_native(Native(ip->b), regs + ip->c, ip->argument_count, regs[ip->a])) {
+                    return false;
+                }
+                ++ip;
+                DISPATCH();
+            }
+            CASE(Return) : {
+                auto value = regs[ip->a];
+                if (frames.empty()) {
+                    result = value;
+                    return true;
+                }
+                const auto& frame = frames.back();
+                function = frame.function;
+                base = frame.base;
+                regs = m_registers.data() + base;
+                constants = function->constants.data();
+                ip = frame.return_ip;
+                regs[frame.result_register] = value;
+                frames.pop_back();
+                DISPATCH();
+            }
+        }
+    }
+
+#undef DISPATCH
+#undef CASE
+#ifdef VM_COMPUTED_GOTO
+#    pragma GCC diagnostic pop
+#endif
+}
+
+bool Interpreter::call_native(Native native, const uint64_t* arguments, size_t argument_count, uint64_t& result) {
+    auto argument = [&](size_t i) -> uint64_t {
+        return i < argument_count ? arguments[i] : 0;
+    };
+    switch (native) {
+    case Native::Deref:
+    case Native::Deref8: {
+        size_t size = native == Native::Deref ? 8 : 1;
+        // the result register is the first argument register
+        auto address = argument(0);
+        if (m_sandboxed && !m_program.is_string_address(address, size)) {
+            return error("memory access outside of string literals");
+        }
+        uint64_t value = 0;
+        std::memcpy(&value, reinterpret_cast<const void*>(address), size);
+        result = value;
+        return true;
+    }
+    case Native::Ref:
+        result = argument(0);
+        return true;
+    case Native::Syscall: {
+        if (m_sandboxed) {
+            return error("syscalls are not allowed here");
+        }
+        long ret = ::syscall(long(argument(0)), argument(1), argument(2), argument(3), argument(4), argument(5));
+        // like the raw syscall instruction, errors are returned as -errno
+        result = uint64_t(ret == -1 ? -long(errno) : ret);
+        return true;
+    }
+    }
+    return error("unknown native function");
+}
+
+bool Interpreter::error(const std::string& what) {
+    m_error = what;
+    return false;
+}
+
+}
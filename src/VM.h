@@ -0,0 +1,155 @@
+#pragma once
+
+#include "ASTParser.h"
+#include "Symbols.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// A register-based bytecode compiler and interpreter, running programs
+// straight from the AST without any external tools.
+namespace VM {
+
+enum class Opcode : uint8_t {
+    LoadConstant, // a = constants[b]
+    Move, // a = b
+    Add, // a = b + c
+    Subtract, // a = b - c
+    Multiply, // a = b * c
+    Jump, // goto b
+    JumpIfZero, // if (a == 0) goto b
+    Match, // goto match_tables[b] target for a
+    Call, // a = functions[b](c, c + 1, ...)
+    CallNative, // a = native b(c, c + 1, ...) with `argument_count` arguments
+    Return, // return a
+};
+
+struct Instruction {
+    Opcode op;
+    uint8_t argument_count { 0 };
+    uint16_t a { 0 };
+    uint32_t b { 0 };
+    uint32_t c { 0 };
+};
+
+enum class Native : uint32_t {
+    Deref,
+    Deref8,
+    Ref,
+    Syscall,
+};
+
+struct MatchTable {
+    // sorted by value
+    std::vector<std::pair<uint64_t, uint32_t>> cases;
+    uint32_t default_target { 0 };
+};
+
+struct Function {
+    std::string name;
+    size_t argument_count { 0 };
+    // arguments come first, then the result, locals and temporaries
+    size_t register_count { 0 };
+    std::vector<Instruction> code;
+    std::vector<uint64_t> constants;
+    std::vector<MatchTable> match_tables;
+};
+
+struct Program {
+    std::vector<Function> functions;
+    std::unordered_map<std::string, uint32_t> function_indices;
+    // string literals, which are addressed by the pointer to their data
+    std::deque<std::string> strings;
+    // literal as written -> index in `strings`, so each is added once
+    std::unordered_map<std::string, size_t> string_indices;
+    // address of each string -> its size including the null terminator
+    std::map<uint64_t, size_t> string_ranges;
+
+    // unescapes a string literal as written in the source, unless it was
+    // added before, and returns the address of its data
+    uint64_t add_string(const std::string& literal, size_t& out_size);
+    // whether the value points into one of the string literals
+    bool is_string_address(uint64_t value, size_t size = 1) const;
+};
+
+class Compiler {
+public:
+    // returns the parsed unit for the path of a `use` declaration
+    using Loader = std::function<std::shared_ptr<AST::Unit>(const std::string& path)>;
+
+    explicit Compiler(Loader loader);
+
+    // adds the unit, and everything it uses through the loader
+    bool add_unit(const std::shared_ptr<AST::Unit>& unit);
+    bool compile(Program& out);
+
+private:
+    bool compile_function(const AST::FunctionDecl& decl, Function& out);
+    bool compile_body(const std::shared_ptr<AST::Body>& body);
+    bool compile_statement(const std::shared_ptr<AST::Statement>& stmt);
+    bool compile_if_statement(const AST::IfStatement& stmt);
+    bool compile_match_statement(const AST::MatchStatement& stmt);
+    bool compile_expression(const std::shared_ptr<AST::Expression>& expr, uint32_t& out);
+    bool compile_term(const std::shared_ptr<AST::Term>& term, uint32_t& out);
+    bool compile_factor(const std::shared_ptr<AST::Factor>& factor, uint32_t& out);
+    bool compile_unary(const std::shared_ptr<AST::Unary>& unary, uint32_t& out);
+    bool compile_call(const AST::FunctionCall& call, uint32_t& out);
+    bool compile_str(const std::shared_ptr<AST::Expression>& expr, uint32_t& out);
+    bool declare_variable(const AST::VariableDecl& decl);
+    bool is_str_argument(uint32_t function_index, size_t index) const;
+
+    uint32_t allocate_register();
+    uint32_t add_constant(uint64_t value);
+    size_t emit(Instruction instruction);
+    bool error(const std::string& what);
+
+    Loader m_loader;
+    std::unordered_set<std::string> m_loaded_paths {};
+    std::vector<std::shared_ptr<AST::FunctionDecl>> m_decls {};
+
+    Program* m_program { nullptr };
+    Function* m_function { nullptr };
+    struct Variable {
+        uint32_t reg;
+        // a str is in two registers, the pointer and then the length
+        bool is_str { false };
+    };
+    ScopedSymbolTable<Variable> m_variables {};
+    // registers below are taken by arguments, the result and locals
+    uint32_t m_locals_end { 0 };
+    uint32_t m_next_register { 0 };
+};
+
+class Interpreter {
+public:
+    explicit Interpreter(const Program& program);
+
+    // stop after this many calls, 0 for no limit
+    void set_call_limit(size_t limit) { m_call_limit = limit; }
+    // only allow reads of string literals and no syscalls, for running code
+    // inside the compiler
+    void set_sandboxed(bool sandboxed) { m_sandboxed = sandboxed; }
+
+    bool call(const std::string& name, const std::vector<uint64_t>& arguments, uint64_t& result);
+    const std::string& error_message() const { return m_error; }
+
+private:
+    bool run(uint32_t function_index, const std::vector<uint64_t>& arguments, uint64_t& result);
+    bool call_native(Native native, const uint64_t* arguments, size_t argument_count, uint64_t& result);
+    bool error(const std::string& what);
+
+    const Program& m_program;
+    std::vector<uint64_t> m_registers;
+    size_t m_call_limit { 0 };
+    bool m_sandboxed { false };
+    std::string m_error;
+};
+
+}